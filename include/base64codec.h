@@ -0,0 +1,69 @@
+#ifndef _BASE64CODEC_H
+#define _BASE64CODEC_H
+
+// Base64 (RFC 4648) encoding and decoding in one pass into a buffer of the
+// caller, without length probing.
+
+#include <stdint.h>
+
+static inline uint16_t base64_len(uint16_t n) { return 4 * ((n + 2) / 3); }
+
+// writes base64 of n bytes to p, returns number of characters
+static inline uint16_t base64_put(char *p, const uint8_t *src, uint16_t n) {
+  static const char digits[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char *const start = p;
+
+  for (; n >= 3; n -= 3, src += 3) {
+    uint32_t const v = src[0] << 16 | src[1] << 8 | src[2];
+    *p++ = digits[v >> 18];
+    *p++ = digits[(v >> 12) & 0x3f];
+    *p++ = digits[(v >> 6) & 0x3f];
+    *p++ = digits[v & 0x3f];
+  }
+  if (n) {
+    uint32_t const v = src[0] << 16 | (n > 1 ? src[1] << 8 : 0);
+    *p++ = digits[v >> 18];
+    *p++ = digits[(v >> 12) & 0x3f];
+    *p++ = n > 1 ? digits[(v >> 6) & 0x3f] : '=';
+    *p++ = '=';
+  }
+  return p - start;
+}
+
+static inline int8_t base64_digit(char c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  return c == '+' ? 62 : c == '/' ? 63 : -1;
+}
+
+// decodes n characters of base64 into at most size bytes, returns number of
+// bytes, or -1 if input is malformed or does not fit
+static inline int base64_get(uint8_t *dst, uint16_t size, const char *src,
+                             uint16_t n) {
+  uint32_t v = 0;
+  uint8_t bits = 0;
+  int len = 0;
+
+  while (n && src[n - 1] == '=')
+    n--; // padding
+  for (uint16_t i = 0; i < n; i++) {
+    int8_t const d = base64_digit(src[i]);
+    if (d < 0)
+      return -1;
+    v = v << 6 | d;
+    if ((bits += 6) >= 8) {
+      bits -= 8;
+      if (len == size)
+        return -1;
+      dst[len++] = (uint8_t)(v >> bits);
+    }
+  }
+  return bits >= 6 ? -1 : len; // a single trailing digit is no byte
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _BEACONSET_H
+#define _BEACONSET_H
+
+// Lookup index for beacon MACs in monitor mode.
+// Beacons are kept as sorted array of MACs, searched binary in O(log n).
+// In front of it sits a 256 bit bloom filter with two probes, so most non
+// beacon MACs are rejected after two bit tests, without touching the array.
+// Keys are the 6 MAC bytes as read from the frame, in little endian order.
+// Each entry packs key and beacon ID into 64 bits as key << 16 | ID, so the
+// array sorts by key and then ID, at 8 bytes per entry.
+//
+// The index is double buffered: build() fills the inactive half and then
+// switches over, so a single writer may rebuild while the MAC processing task
+// keeps looking up.
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+template <uint16_t N> class BeaconSet {
+
+public:
+  BeaconSet() : active(0) {
+    memset(index, 0, sizeof(index));
+  }
+
+  // rebuild index from array of beacon MACs in macConvert() format, array
+  // position is beacon ID, zero entries are unused
+  void build(const uint64_t *beacons) {
+    Index &x = index[active.load(std::memory_order_relaxed) ^ 1];
+    uint16_t n = 0;
+    memset(x.bloom, 0, sizeof(x.bloom));
+    for (uint16_t id = 0; id < N; id++) {
+      if (!beacons[id])
+        continue;
+      // macConvert() yields MAC in big endian order, swap to frame order
+      const uint64_t key = __builtin_bswap64(beacons[id] << 16);
+      x.entry[n++] = key << 16 | id;
+      bloomset(x, key);
+    }
+    // equal keys sort by ID, so lowest ID wins as with linear search
+    std::sort(x.entry, x.entry + n);
+    x.count = n;
+    active.store(active.load(std::memory_order_relaxed) ^ 1,
+                 std::memory_order_release);
+  }
+
+  // returns beacon ID of 6 byte MAC, or -1 if MAC is not a beacon
+  int16_t find(const uint8_t *mac) const {
+    const Index &x = index[active.load(std::memory_order_acquire)];
+    uint64_t key = 0;
+    memcpy(&key, mac, 6);
+    if (!bloomtest(x, key))
+      return -1;
+    const uint64_t *e = std::lower_bound(x.entry, x.entry + x.count, key << 16);
+    return (e != x.entry + x.count && (*e >> 16) == key) ? (*e & 0xffff) : -1;
+  }
+
+  uint16_t size(void) const {
+    return index[active.load(std::memory_order_acquire)].count;
+  }
+
+private:
+  typedef struct {
+    uint32_t bloom[8]; // 256 bits
+    uint64_t entry[N];
+    uint16_t count;
+  } Index;
+
+  static uint32_t mix(uint64_t key) {
+    return (uint32_t)((key ^ (key >> 29)) * 0x9E3779B97F4A7C15ULL >> 32);
+  }
+
+  static void bloomset(Index &x, uint64_t key) {
+    const uint32_t h = mix(key);
+    x.bloom[(h >> 5) & 7] |= 1UL << (h & 31);
+    x.bloom[(h >> 13) & 7] |= 1UL << ((h >> 8) & 31);
+  }
+
+  static bool bloomtest(const Index &x, uint64_t key) {
+    const uint32_t h = mix(key);
+    return (x.bloom[(h >> 5) & 7] & (1UL << (h & 31))) &&
+           (x.bloom[(h >> 13) & 7] & (1UL << ((h >> 8) & 31)));
+  }
+
+  Index index[2];
+  std::atomic<uint8_t> active;
+};
+
+#endif
@@ -9,7 +9,7 @@
 #include <map>
 
 bool cwa_init(void);
-void cwa_mac_add(uint16_t hashedmac);
+void cwa_mac_add(hashedmac_t hashedmac);
 void cwa_clear(void);
 uint16_t cwa_report(void);
 
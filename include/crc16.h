@@ -0,0 +1,27 @@
+#ifndef _CRC16_H
+#define _CRC16_H
+
+// CRC-16/GENIBUS, as crc16_be(0, ...) of ESP32 ROM, which is used on target.
+// Check value of "123456789" is 0xd64e.
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include <rom/crc.h>
+#endif
+
+static inline uint16_t crc16_genibus(const uint8_t *p, uint32_t len) {
+#ifdef ESP_PLATFORM
+  return crc16_be(0, p, len);
+#else
+  uint16_t crc = 0xffff;
+  while (len--) {
+    crc ^= (uint16_t)*p++ << 8;
+    for (uint8_t k = 0; k < 8; k++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return ~crc;
+#endif
+}
+
+#endif
@@ -11,11 +11,12 @@
 #include <RtcDateTime.h>
 #include <Ticker.h>
 
-// std::set for unified array functions
-#include <set>
+// container for unique MACs and unified array functions
+#include "macset.h"
+#include "maccounter.h"
+#include "msgpool.h"
 #include <array>
 #include <algorithm>
-#include "mallocator.h"
 #include <bsec.h>
 
 #define _bit(b) (1U << (b))
@@ -51,8 +52,55 @@
 
 #define _seconds() millis() / 1000.0
 
+// width of hashed MACs, see macset.h
+#ifndef MAC_HASH_BITS
+#define MAC_HASH_BITS 16
+#endif
+// largest crowd per send cycle counted with 24 / 32 bit hashed MACs
+#ifndef MAC_SET_CROWD
+#define MAC_SET_CROWD 5000
+#endif
+#ifndef MAC_SET_SLOTS
+#define MAC_SET_SLOTS macset_slots(MAC_SET_CROWD)
+#endif
+
+static_assert(MAC_HASH_BITS == 16 || MAC_SET_SLOTS / 4 * 3 >= MAC_SET_CROWD,
+              "MAC_SET_SLOTS holds less than MAC_SET_CROWD MACs per cycle");
+
+typedef MacSet<MAC_HASH_BITS, MAC_SET_SLOTS> MacSet_t;
+typedef MacSet_t::key_t hashedmac_t;
+
+#if (HAS_LORA)
+#define SEND_TRANSPORT_LORA 1
+#else
+#define SEND_TRANSPORT_LORA 0
+#endif
+#ifdef HAS_SPI
+#define SEND_TRANSPORT_SPI 1
+#else
+#define SEND_TRANSPORT_SPI 0
+#endif
+#ifdef HAS_MQTT
+#define SEND_TRANSPORT_MQTT 1
+#else
+#define SEND_TRANSPORT_MQTT 0
+#endif
+
+// payload buffers held besides queued ones: payload being built, message
+// being sent by LoRa and its merged series, message moved by spool task
+#ifndef SEND_POOL_INFLIGHT
+#define SEND_POOL_INFLIGHT 4
+#endif
+
+// number of payload buffers shared by all send queues, see msgpool.h. One
+// buffer serves all transports, so the queues share one budget. If stalled
+// transports hold more, alloc() fails and the new payload is dropped, as it
+// is by a full send queue.
+#ifndef SEND_POOL_SIZE
+#define SEND_POOL_SIZE (SEND_QUEUE_SIZE + SEND_POOL_INFLIGHT)
+#endif
+
 enum timesource_t { _gps, _rtc, _lora, _unsynced };
-enum snifftype_t { MAC_SNIFF_WIFI, MAC_SNIFF_BLE, MAC_SNIFF_BLE_ENS };
 enum runmode_t {
   RUNMODE_POWERCYCLE,
   RUNMODE_NORMAL,
@@ -100,12 +148,16 @@ typedef struct {
   uint8_t Message[PAYLOAD_BUFFER_SIZE];
 } MessageBuffer_t;
 
-// Struct for MAC processing queue
+typedef MsgPool<MessageBuffer_t, SEND_POOL_SIZE> SendPool_t;
+
+// Struct holding MAC processing pipeline statistics of one sniffer
 typedef struct {
-  uint8_t mac[6];
-  int8_t rssi;
-  snifftype_t sniff_type;
-} MacBuffer_t;
+  uint32_t analyzed; // MACs processed since boot
+  uint32_t dropped;  // MACs lost due to full ring since boot
+  uint32_t filtered; // MACs dropped by early duplicate filter since boot
+  uint32_t p50, p99; // [us] processing latency percentiles since last query
+  uint32_t peak;     // max. MACs waiting in ring since last query
+} pipelineStatus_t;
 
 typedef struct {
   int32_t latitude;
@@ -131,8 +183,8 @@ typedef struct {
   float pm25;
 } sdsStatus_t;
 
-extern std::set<uint16_t, std::less<uint16_t>, Mallocator<uint16_t>> macs;
-extern std::array<uint64_t, 0xff>::iterator it;
+extern MacSet_t macs;
+extern SendPool_t sendpool;
 extern std::array<uint64_t, 0xff> beacons;
 
 extern configData_t cfg;                       // current device configuration
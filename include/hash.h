@@ -3,7 +3,8 @@
 
 #include <Arduino.h>
 #include <RokkitHash.h>
+#include "keyhash.h"
 
 uint32_t IRAM_ATTR myhash(const char *data, int len);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,95 @@
+#ifndef _HYPERLOGLOG_H
+#define _HYPERLOGLOG_H
+
+// HyperLogLog cardinality estimator for 32 bit hashes, see
+// Flajolet et al., "HyperLogLog: the analysis of a near-optimal cardinality
+// estimation algorithm", 2007.
+//
+// Uses 2^P registers of one byte each, standard error is 1.04 / sqrt(2^P),
+// e.g. P = 11 -> 2 KB, 2.3%. The harmonic sum of the registers is kept
+// up to date on each insert, so estimate() runs in constant time.
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+template <uint8_t P> class HyperLogLog {
+
+  static_assert(P >= 4 && P <= 16, "HyperLogLog precision must be 4..16");
+
+public:
+  HyperLogLog() { clear(); }
+
+  // returns true if sketch has changed, i.e. estimate may have changed
+  bool add(uint32_t hash) {
+    const uint32_t idx = hash >> (32 - P);
+    const uint32_t w = hash << P;
+    const uint8_t rho = w ? __builtin_clz(w) + 1 : MAXRHO;
+    const uint8_t old = reg[idx];
+    if (rho <= old)
+      return false;
+    reg[idx] = rho;
+    sum -= term(old);
+    sum += term(rho);
+    if (old == 0)
+      zeros--;
+    return true;
+  }
+
+  // merge other sketch into this one, result estimates cardinality of union
+  void merge(const HyperLogLog<P> &other) {
+    for (uint32_t i = 0; i < M; i++)
+      if (other.reg[i] > reg[i])
+        reg[i] = other.reg[i];
+    recalc();
+  }
+
+  uint32_t estimate(void) const {
+    const float m = (float)M;
+    float e = alpha() * m * m / ((float)sum / (float)term(0));
+    // small range correction, using linear counting
+    if ((e <= 2.5f * m) && zeros)
+      e = m * logf(m / (float)zeros);
+    return (uint32_t)(e + 0.5f);
+  }
+
+  void clear(void) {
+    memset(reg, 0, sizeof(reg));
+    sum = (uint64_t)M * term(0);
+    zeros = M;
+  }
+
+  static constexpr uint32_t registers(void) { return M; }
+
+private:
+  static constexpr uint32_t M = 1UL << P;
+  static constexpr uint8_t MAXRHO = 32 - P + 1;
+
+  // 2^-rho, scaled by 2^MAXRHO to keep the sum an exact integer
+  static constexpr uint64_t term(uint8_t rho) {
+    return (uint64_t)1 << (MAXRHO - rho);
+  }
+
+  static constexpr float alpha(void) {
+    return (M == 16)   ? 0.673f
+           : (M == 32) ? 0.697f
+           : (M == 64) ? 0.709f
+                       : 0.7213f / (1.0f + 1.079f / (float)M);
+  }
+
+  void recalc(void) {
+    sum = 0;
+    zeros = 0;
+    for (uint32_t i = 0; i < M; i++) {
+      sum += term(reg[i]);
+      if (reg[i] == 0)
+        zeros++;
+    }
+  }
+
+  uint8_t reg[M];
+  uint64_t sum;
+  uint32_t zeros;
+};
+
+#endif
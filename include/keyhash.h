@@ -0,0 +1,59 @@
+#ifndef _KEYHASH_H
+#define _KEYHASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR // host build
+#endif
+
+// Keyed hash for short inputs of fixed width, based on MurmurHash3 x86_32
+// with the key used as seed. Since LEN is known at compile time the block
+// loop and tail handling unroll to a few multiplies and shifts. Finalizer
+// gives full avalanche, so truncating the result to 16 bits keeps collisions
+// close to the birthday bound.
+
+static inline uint32_t hash_rotl(uint32_t x, uint8_t r) {
+  return (x << r) | (x >> (32 - r));
+}
+
+// mixes all input bits into all output bits
+static inline uint32_t hash_fmix(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+template <uint8_t LEN>
+inline uint32_t IRAM_ATTR keyhash(const void *data, uint32_t key) {
+  const uint8_t *p = (const uint8_t *)data;
+  uint32_t h = key, k;
+
+  for (uint8_t i = 0; i + 4 <= LEN; i += 4) {
+    memcpy(&k, p + i, 4); // unaligned safe load
+    k *= 0xcc9e2d51;
+    k = hash_rotl(k, 15);
+    k *= 0x1b873593;
+    h ^= k;
+    h = hash_rotl(h, 13);
+    h = h * 5 + 0xe6546b64;
+  }
+
+  if (LEN & 3) {
+    k = 0;
+    for (uint8_t i = 0; i < (LEN & 3); i++)
+      k |= (uint32_t)p[(LEN & ~3) + i] << (8 * i);
+    k *= 0xcc9e2d51;
+    k = hash_rotl(k, 15);
+    k *= 0x1b873593;
+    h ^= k;
+  }
+
+  return hash_fmix(h ^ LEN);
+}
+
+#endif
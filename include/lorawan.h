@@ -8,16 +8,69 @@
 
 // LMIC-Arduino LoRaWAN Stack
 #include <lmic.h>
+#include <lmic/lmic_bandplan.h>
 #include <hal/hal.h>
 #include <SPI.h>
 #include <arduino_lmic_hal_boards.h>
 #include "loraconf.h"
+#include "prioqueue.h"
+#include "seriescodec.h"
 
 // Needed for 24AA02E64, does not hurt anything if included and not used
 #ifdef MCP_24AA02E64_I2C_ADDRESS
 #include <Wire.h>
 #endif
 
+// LoRaWAN frame bytes besides application payload: MHDR, FHDR without FOpts,
+// FPort, MIC
+#define LORA_FRAME_OVERHEAD 13
+
+// priority classes of LoRa send queue, ports are mapped in paxcounter.conf
+#define LORA_PRIO_HIGH 0
+#define LORA_PRIO_MID 1
+#define LORA_PRIO_LOW 2
+#define LORA_PRIO_CLASSES 3
+
+#ifndef SEND_PRIO_HIGH_PORTS
+#define SEND_PRIO_HIGH_PORTS BEACONPORT, BUTTONPORT, TIMEPORT
+#endif
+#ifndef SEND_PRIO_MID_PORTS
+#define SEND_PRIO_MID_PORTS STATUSPORT, CONFIGPORT
+#endif
+#ifndef SEND_PRIO_HIGH_SIZE
+#define SEND_PRIO_HIGH_SIZE 3
+#endif
+#ifndef SEND_PRIO_MID_SIZE
+#define SEND_PRIO_MID_SIZE 3
+#endif
+#ifndef SEND_PRIO_LOW_SIZE
+#define SEND_PRIO_LOW_SIZE SEND_QUEUE_SIZE
+#endif
+
+// merge new messages into queued ones while LoRa is backlogged
+#ifndef SEND_COALESCE
+#define SEND_COALESCE 0
+#endif
+#ifndef SEND_LATEST_PORTS
+#define SEND_LATEST_PORTS GPSPORT, BMEPORT, BATTPORT, WINDOWPORT
+#endif
+
+#ifndef SERIES_DELTA
+#define SERIES_DELTA 1
+#endif
+#if (SERIES_DELTA)
+#define SERIES_HEADER(len) (SERIES_DELTA_FLAG | (len))
+#else
+#define SERIES_HEADER(len) (len)
+#endif
+
+#if (SEND_COALESCE) && (PAYLOAD_ENCODER > 2)
+#error SEND_COALESCE needs plain or packed payload encoder
+#endif
+
+typedef PrioQueue<MessageBuffer_t *, LORA_PRIO_CLASSES, SEND_QUEUE_SIZE>
+    LoraQueue_t;
+
 extern TaskHandle_t lmicTask, lorasendTask;
 
 esp_err_t lmic_init(void);
@@ -35,6 +88,8 @@ void lora_send(void *pvParameters);
 void lora_enqueuedata(MessageBuffer_t *message);
 void lora_queuereset(void);
 uint32_t lora_queuewaiting(void);
+bool lora_queueready(uint8_t port);
+uint8_t lora_maxpayload(void);
 uint8_t myBattLevelCb(void *pUserData);
 void IRAM_ATTR myEventCallback(void *pUserData, ev_t ev);
 void IRAM_ATTR myRxCallback(void *pUserData, uint8_t port, const uint8_t *pMsg,
@@ -0,0 +1,295 @@
+#ifndef _MACCOUNTER_H
+#define _MACCOUNTER_H
+
+// Counting core of the MAC pipeline, free of Arduino and FreeRTOS, so that
+// tools/replay runs sniffed frames through the same code as the device.
+//
+// add() is the sniffer side of mac_add(): early duplicate filter, then one
+// lock-free ring per sniffer. analyze() is the counting part of
+// mac_analyze(): rssi limit, salted hash, MAC container, sliding window and,
+// in cumulative mode, HyperLogLog sketches. reset() is the counter part of
+// reset_counters(). LED, beacon alarm, ENS, statistics and logging stay in
+// macsniff.cpp. Features are selected by the same defines as in
+// paxcounter.conf.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "keyhash.h"
+#include "macset.h"
+#include "macdedup.h"
+#include "spscring.h"
+#include "hyperloglog.h"
+#include "slidingwindow.h"
+
+#ifndef MAC_QUEUE_SIZE
+#define MAC_QUEUE_SIZE 50
+#endif
+
+#ifndef MAC_DEDUP_SIZE
+#define MAC_DEDUP_SIZE 0
+#endif
+
+#ifndef HLL_COUNTER
+#define HLL_COUNTER 0
+#endif
+
+#ifndef HLL_PRECISION
+#define HLL_PRECISION 11
+#endif
+
+#ifndef SLIDING_WINDOW
+#define SLIDING_WINDOW 0
+#endif
+
+#if (MAC_DEDUP_SIZE) & (MAC_DEDUP_SIZE - 1)
+#error MAC_DEDUP_SIZE must be a power of 2
+#endif
+
+#if (SLIDING_WINDOW)
+// windows span the current bucket and up to SLIDING_WINDOW_BUCKETS - 1
+// complete ones, see slidingwindow.h
+static_assert(SLIDING_WINDOW_LONG <=
+                  SLIDING_WINDOW_BUCKET * (SLIDING_WINDOW_BUCKETS - 1),
+              "SLIDING_WINDOW_LONG exceeds history kept in buckets");
+#endif
+
+enum snifftype_t { MAC_SNIFF_WIFI, MAC_SNIFF_BLE, MAC_SNIFF_BLE_ENS };
+
+// Struct for MAC processing queue
+typedef struct {
+  uint8_t mac[6];
+  int8_t rssi;
+  snifftype_t sniff_type;
+  uint32_t stamp; // [us] time of enqueuing, for latency statistics
+} MacBuffer_t;
+
+// results of add()
+#define MAC_ADD_FILTERED 0 // repeat, dropped by duplicate filter
+#define MAC_ADD_DROPPED 1  // ring full, counted by ring
+#define MAC_ADD_QUEUED 2   // enqueued
+#define MAC_ADD_WAKE 3     // enqueued into empty ring, consumer may sleep
+
+// results of analyze()
+#define MAC_COUNT_IGNORED 0 // below rssi limit
+#define MAC_COUNT_KNOWN 1   // already counted
+#define MAC_COUNT_NEW 2     // counted
+#define MAC_COUNT_FULL 3    // new, but rejected by full MAC container
+
+typedef SpscRing<MacBuffer_t, MAC_QUEUE_SIZE> MacRing_t;
+
+template <class SET> class MacCounter {
+
+public:
+  typedef typename SET::key_t key_t;
+
+  MacCounter(SET &macs, volatile uint16_t &wifi, volatile uint16_t &ble)
+      : macs(macs), wifi(wifi), ble(ble), salt(0), window_salt(0),
+        last_epoch(0) {}
+
+  // sniffer side, called by one producer context per sniffer type
+  inline __attribute__((always_inline)) uint8_t
+  add(const uint8_t *paddr, int8_t rssi, snifftype_t sniff_type,
+      uint32_t stamp, int16_t rssilimit, bool monitormode) {
+
+    MacBuffer_t MacBuffer;
+    MacRing_t &r = ring(sniff_type);
+
+#if (MAC_DEDUP_SIZE)
+    // drop MACs already seen in this cycle, unless we are watching for
+    // beacons or the frame would be rejected by rssi limiter anyway
+    MacDedup<MAC_DEDUP_SIZE> &seen =
+        (sniff_type == MAC_SNIFF_WIFI) ? wifi_seen : ble_seen;
+    const bool dedup = !monitormode && !(rssilimit && rssi < rssilimit);
+    if (dedup && seen.seen(paddr))
+      return MAC_ADD_FILTERED;
+#endif
+
+    MacBuffer.rssi = rssi;
+    MacBuffer.sniff_type = sniff_type;
+    MacBuffer.stamp = stamp;
+    memcpy(MacBuffer.mac, paddr, 6);
+
+    const bool was_empty = r.empty();
+
+    if (!r.push(MacBuffer))
+      return MAC_ADD_DROPPED; // dense radio traffic, packet lost
+
+#if (MAC_DEDUP_SIZE)
+    // remember MAC only once enqueued, so a lost one is taken with next frame
+    if (dedup)
+      seen.pass(paddr);
+#endif
+
+    return was_empty ? MAC_ADD_WAKE : MAC_ADD_QUEUED;
+  }
+
+  // counts a MAC taken from a ring, returns MAC_COUNT_xxx and its hash
+  uint8_t analyze(const MacBuffer_t &MacBuffer, int16_t rssilimit,
+                  bool cumulative, uint32_t epoch, key_t &hashedmac) {
+
+    hashedmac = 0;
+    if (rssilimit && MacBuffer.rssi < rssilimit) // rssi is negative value
+      return MAC_COUNT_IGNORED;
+
+    // only last 3 MAC Address bytes are used for MAC address anonymization
+    // but since it's uint32 we take 4 bytes to avoid 1st value to be 0.
+    // this gets MAC in msb (= reverse) order, but doesn't matter for hashing.
+    const uint8_t *mac = MacBuffer.mac + 2;
+
+    // hashed 4 byte MAC, keyed with current salt, to save RAM only the lower
+    // bits of the hash are kept in the container
+    // https://en.wikipedia.org/wiki/MAC_Address_Anonymization
+    const uint32_t hash = keyhash<4>(mac, salt);
+    hashedmac = hash;
+
+    // add hashed MAC, count only if it was not yet in container
+    const uint32_t overflows = macs.overflow();
+    uint8_t result = MAC_COUNT_KNOWN;
+    if (macs.insert(hashedmac)) {
+      if (MacBuffer.sniff_type == MAC_SNIFF_WIFI)
+        wifi++;
+      else
+        ble++;
+      result = MAC_COUNT_NEW;
+    } else if (macs.overflow() != overflows)
+      result = MAC_COUNT_FULL;
+
+#if (SLIDING_WINDOW)
+    // sliding window uses it's own salt, since it spans several send cycles
+    if (epoch != last_epoch) {
+      // a new bucket must see repeated MACs again
+      clear_seen();
+      last_epoch = epoch;
+    }
+    window.add(keyhash<4>(mac, window_salt), epoch);
+#else
+    (void)epoch;
+#endif
+
+#if (HLL_COUNTER)
+    // in cumulative mode counters are estimated from sketches, which keep
+    // constant size regardless of crowd size
+    if (cumulative) {
+      if (MacBuffer.sniff_type == MAC_SNIFF_WIFI) {
+        wifi_sketch.add(hash);
+        wifi = clamp(wifi_sketch.estimate());
+      } else {
+        ble_sketch.add(hash);
+        ble = clamp(ble_sketch.estimate());
+      }
+    }
+#else
+    (void)cumulative;
+#endif
+
+    return result;
+  }
+
+  // clears counters, container, sketches and duplicate filter for a new cycle
+  void reset(void) {
+    macs.clear();
+    clear_seen();
+#if (HLL_COUNTER)
+    wifi_sketch.clear();
+    ble_sketch.clear();
+#endif
+    wifi = 0;
+    ble = 0;
+  }
+
+  // new salt for hashed MACs, window salt is set once, as it must outlive
+  // the per cycle salt
+  void rekey(uint32_t cycle, uint32_t window) {
+    salt = cycle;
+    if (!window_salt)
+      window_salt = window;
+  }
+
+  MacRing_t &ring(snifftype_t sniff_type) {
+    return (sniff_type == MAC_SNIFF_WIFI) ? wifi_ring : ble_ring;
+  }
+
+  // forget MACs seen by duplicate filter, may be called from any context
+  void clear_seen(void) {
+#if (MAC_DEDUP_SIZE)
+    wifi_seen.clear();
+    ble_seen.clear();
+#endif
+  }
+
+  // frames dropped as repeats, and passed, by duplicate filter
+  uint32_t dedup_hits(snifftype_t sniff_type) const {
+#if (MAC_DEDUP_SIZE)
+    return (sniff_type == MAC_SNIFF_WIFI) ? wifi_seen.hitcount()
+                                          : ble_seen.hitcount();
+#else
+    (void)sniff_type;
+    return 0;
+#endif
+  }
+
+  uint32_t dedup_misses(snifftype_t sniff_type) const {
+#if (MAC_DEDUP_SIZE)
+    return (sniff_type == MAC_SNIFF_WIFI) ? wifi_seen.misscount()
+                                          : ble_seen.misscount();
+#else
+    (void)sniff_type;
+    return 0;
+#endif
+  }
+
+  // MACs lost due to full ring
+  uint32_t drops(snifftype_t sniff_type) const {
+    return (sniff_type == MAC_SNIFF_WIFI) ? wifi_ring.dropped()
+                                          : ble_ring.dropped();
+  }
+
+#if (SLIDING_WINDOW)
+  // time bucket of sliding window at <ms>
+  static uint32_t epoch(uint32_t ms) {
+    return ms / (SLIDING_WINDOW_BUCKET * 60000UL);
+  }
+
+  // estimated unique MACs seen in the last <minutes> up to <ms>, rounded up
+  // to buckets
+  uint16_t window_count(uint8_t minutes, uint32_t ms) {
+    const uint32_t period = SLIDING_WINDOW_BUCKET * 60000UL;
+    const uint8_t n =
+        (minutes + SLIDING_WINDOW_BUCKET - 1) / SLIDING_WINDOW_BUCKET;
+    return clamp(window.estimate(n, ms / period, ms % period, period));
+  }
+#else
+  static uint32_t epoch(uint32_t) { return 0; }
+  uint16_t window_count(uint8_t, uint32_t) { return 0; }
+#endif
+
+private:
+  SET &macs;
+  volatile uint16_t &wifi, &ble;
+  uint32_t salt, window_salt, last_epoch;
+
+  // lock-free rings between sniffer callbacks and MAC processing task, one
+  // per producer, since wifi and bluetooth callbacks run in different tasks
+  MacRing_t wifi_ring, ble_ring;
+
+#if (MAC_DEDUP_SIZE)
+  // caches of MAC tails already enqueued in current count cycle, one per
+  // sniffer, used to drop repeated frames before they hit the rings
+  MacDedup<MAC_DEDUP_SIZE> wifi_seen, ble_seen;
+#endif
+
+#if (HLL_COUNTER)
+  // constant size cardinality sketches used in cumulative counter mode
+  HyperLogLog<HLL_PRECISION> wifi_sketch, ble_sketch;
+#endif
+
+#if (SLIDING_WINDOW)
+  // sketches of unique MACs per time bucket, spanning several send cycles
+  SlidingWindow<SLIDING_WINDOW_PRECISION, SLIDING_WINDOW_BUCKETS> window;
+#endif
+
+  static uint16_t clamp(uint32_t n) { return n < UINT16_MAX ? n : UINT16_MAX; }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _MACDEDUP_H
+#define _MACDEDUP_H
+
+// Early duplicate filter for sniffed MACs.
+// Direct mapped cache of the 4 byte MAC tails already passed in the current
+// count cycle, used to drop repeated frames before they are enqueued. A MAC is
+// remembered by pass() only once it was enqueued, and a collision just evicts
+// the older tail, so the filter may pass a repeat but never drops a new MAC.
+// seen() and pass() must be called by one producer context. clear() may be
+// called from any context, the producer empties the cache on its next call of
+// seen(). N must be a power of 2.
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+template <uint32_t N> class MacDedup {
+
+  static_assert(N && !(N & (N - 1)), "MacDedup size must be power of 2");
+
+public:
+  MacDedup() : generation(0), cleared(0), hits(0), misses(0) {
+    memset(tails, 0, sizeof(tails));
+  }
+
+  // returns true if MAC was passed before, called by producer
+  inline __attribute__((always_inline)) bool seen(const uint8_t *paddr) {
+    const uint32_t g = generation.load(std::memory_order_acquire);
+    if (g != cleared) {
+      memset(tails, 0, sizeof(tails));
+      cleared = g;
+    }
+    const uint32_t tail = key(paddr);
+    if (tail && *slot(tail) == tail) {
+      hits++;
+      return true;
+    }
+    return false;
+  }
+
+  // remembers MAC after it was enqueued, called by producer
+  inline __attribute__((always_inline)) void pass(const uint8_t *paddr) {
+    const uint32_t tail = key(paddr);
+    *slot(tail) = tail;
+    misses++;
+  }
+
+  // forget all MACs, keeps hit / miss counters
+  void clear(void) { generation.fetch_add(1, std::memory_order_release); }
+
+  uint32_t hitcount(void) const { return hits; }
+  uint32_t misscount(void) const { return misses; }
+
+private:
+  uint32_t tails[N];
+  std::atomic<uint32_t> generation; // clear requests
+  uint32_t cleared;                 // clear requests done by producer
+  volatile uint32_t hits, misses;
+
+  // same 4 bytes as used for hashing
+  static uint32_t key(const uint8_t *paddr) {
+    uint32_t tail;
+    memcpy(&tail, paddr + 2, 4);
+    return tail;
+  }
+
+  uint32_t *slot(uint32_t tail) {
+    return &tails[((uint32_t)(tail * 2654435761UL) >> 16) & (N - 1)];
+  }
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef _MACSET_H
+#define _MACSET_H
+
+// Container for unique hashed MACs, templated on fingerprint width.
+//
+// 16 bit: a bitmap covering the whole key space gives O(1) insert, size and
+// clear with a fixed footprint of 8 KB, no per entry heap allocations and no
+// heap fragmentation. It undercounts once the crowd reaches a few hundred
+// devices, due to birthday collisions of the fingerprints.
+//
+// 24 / 32 bit: a bitmap is no longer feasible, so fingerprints are kept in an
+// open addressing table of SLOTS entries with linear probing. Entries are
+// packed to BITS/8 bytes, i.e. 3 or 4 bytes per slot. Fingerprint 0 marks an
+// empty slot and is stored as 1. To keep probe sequences short, the table
+// accepts up to 3/4 of SLOTS entries, further new keys are rejected and
+// counted as overflow. So counts are capped at 3/4 of SLOTS per cycle, and
+// SLOTS must be chosen from the largest expected crowd with macset_slots(),
+// otherwise 24 / 32 bit undercount more than 16 bit does, see tools/macsetsim.
+
+#include <stdint.h>
+#include <string.h>
+
+// smallest power of 2 number of slots holding crowd keys
+constexpr uint32_t macset_slots(uint32_t crowd, uint32_t slots = 64) {
+  return slots / 4 * 3 >= crowd ? slots : macset_slots(crowd, 2 * slots);
+}
+
+template <uint8_t BITS, uint32_t SLOTS> class MacSet {
+
+  static_assert(BITS == 24 || BITS == 32, "MacSet width must be 16, 24 or 32");
+  static_assert((SLOTS & (SLOTS - 1)) == 0, "MacSet slots must be power of 2");
+
+public:
+  typedef uint32_t key_t;
+
+  MacSet() { clear(); }
+
+  // returns true if key was not yet in set
+  bool insert(key_t key) {
+    key = fingerprint(key);
+    uint32_t i = slot(key);
+    for (key_t k; (k = load(i)) != 0; i = (i + 1) & (SLOTS - 1))
+      if (k == key)
+        return false;
+    if (count >= MAXFILL) {
+      overflows++;
+      return false;
+    }
+    store(i, key);
+    count++;
+    return true;
+  }
+
+  bool contains(key_t key) const {
+    key = fingerprint(key);
+    uint32_t i = slot(key);
+    for (key_t k; (k = load(i)) != 0; i = (i + 1) & (SLOTS - 1))
+      if (k == key)
+        return true;
+    return false;
+  }
+
+  uint32_t size(void) const { return count; }
+
+  // number of new keys rejected since table was full
+  uint32_t overflow(void) const { return overflows; }
+
+  void clear(void) {
+    memset(table, 0, sizeof(table));
+    count = 0;
+    overflows = 0;
+  }
+
+private:
+  static constexpr uint8_t BYTES = BITS / 8;
+  static constexpr uint32_t MAXFILL = SLOTS / 4 * 3;
+
+  static key_t fingerprint(key_t key) {
+    if (BITS < 32)
+      key &= (uint32_t)((1ULL << BITS) - 1);
+    return key ? key : 1;
+  }
+
+  // keys are hashes, so upper bits are good enough as slot index. Product is
+  // 32 bit as on ESP32, also where unsigned long has 64 bit.
+  static uint32_t slot(key_t key) {
+    return ((uint32_t)(key * 2654435761UL) >> 8) & (SLOTS - 1);
+  }
+
+  key_t load(uint32_t i) const {
+    key_t k = 0;
+    memcpy(&k, table + i * BYTES, BYTES);
+    return k;
+  }
+
+  void store(uint32_t i, key_t key) { memcpy(table + i * BYTES, &key, BYTES); }
+
+  uint8_t table[SLOTS * BYTES];
+  uint32_t count;
+  uint32_t overflows;
+};
+
+template <uint32_t SLOTS> class MacSet<16, SLOTS> {
+
+public:
+  typedef uint16_t key_t;
+
+  MacSet() { clear(); }
+
+  // returns true if key was not yet in set
+  bool insert(key_t key) {
+    const uint32_t mask = 1UL << (key & 0x1f);
+    uint32_t *word = &bitmap[key >> 5];
+    if (*word & mask)
+      return false;
+    *word |= mask;
+    count++;
+    return true;
+  }
+
+  bool contains(key_t key) const {
+    return bitmap[key >> 5] & (1UL << (key & 0x1f));
+  }
+
+  uint32_t size(void) const { return count; }
+
+  uint32_t overflow(void) const { return 0; }
+
+  void clear(void) {
+    memset(bitmap, 0, sizeof(bitmap));
+    count = 0;
+  }
+
+private:
+  uint32_t bitmap[0x10000 / 32];
+  uint32_t count;
+};
+
+#endif
@@ -3,12 +3,35 @@
 
 // ESP32 Functions
 #include <esp_wifi.h>
+#include <esp_timer.h>
 
 // Hash function for scrambling MAC addresses
 #include "hash.h"
 #include "senddata.h"
 #include "cyclic.h"
 #include "led.h"
+#include "macstats.h"
+#include "beaconset.h"
+
+// max. number of MACs processed from one ring before switching to the other
+#define MAC_BATCH_SIZE 16
+// max. time MAC processing task sleeps without notification from sniffers
+#define MAC_RING_TIMEOUT_MS 100
+
+// per MAC diagnostics are traced to a ring, which is formatted by a low
+// priority task every MAC_TRACE_INTERVAL_MS, only with verbose logging
+#if (VERBOSE) && (CORE_DEBUG_LEVEL >= 5)
+#ifndef MAC_TRACE_SIZE
+#define MAC_TRACE_SIZE 32
+#endif
+#else
+#undef MAC_TRACE_SIZE
+#define MAC_TRACE_SIZE 0
+#endif
+#define MAC_TRACE_INTERVAL_MS 500
+
+// min. interval between LED blinks for counted MACs
+#define MAC_BLINK_INTERVAL_MS 100
 
 #if (COUNT_ENS)
 #include "corona.h"
@@ -16,10 +39,20 @@
 
 uint32_t renew_salt(void);
 uint64_t macConvert(uint8_t *paddr);
+int16_t isBeacon(const uint8_t *mac);
+void mac_beacons_update(void);
 esp_err_t macQueueInit(void);
 void mac_process(void *pvParameters);
+void mac_trace(void *pvParameters);
 void IRAM_ATTR mac_add(uint8_t *paddr, int8_t rssi, snifftype_t sniff_type);
-uint16_t mac_analyze(MacBuffer_t MacBuffer);
+hashedmac_t mac_analyze(MacBuffer_t MacBuffer);
+uint32_t mac_drops(snifftype_t sniff_type);
+void mac_pipeline_status(pipelineStatus_t *status, snifftype_t sniff_type);
+void mac_reset(void);
+uint32_t mac_window_epoch(void);
+uint16_t mac_window_count(uint8_t minutes);
+uint32_t mac_dedup_hits(snifftype_t sniff_type);
+uint32_t mac_dedup_misses(snifftype_t sniff_type);
 void printKey(const char *name, const uint8_t *key, uint8_t len, bool lsb);
 
 #endif
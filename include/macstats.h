@@ -0,0 +1,65 @@
+#ifndef _MACSTATS_H
+#define _MACSTATS_H
+
+// Latency and occupancy statistics of a MAC processing ring.
+// Latencies from mac_add() to mac_analyze() are counted in a log2 histogram,
+// bin i holds latencies of 2^i .. 2^(i+1)-1 microseconds, bin 0 also holds 0,
+// last bin holds all longer latencies. Percentiles are reported as upper bound
+// of the bin they fall into, which is exact enough to tell microseconds from
+// milliseconds at a cost of one clz per MAC.
+// record() and peak() are called by the consumer task only, readers on other
+// tasks may see slightly inconsistent snapshots, which is fine for statistics.
+
+#include <stdint.h>
+#include <string.h>
+
+#define MAC_STATS_BINS 20 // up to ~1 s
+
+class MacStats {
+
+public:
+  MacStats() : analyzed(0) { clear(); }
+
+  void record(uint32_t latency_us) {
+    const uint8_t b = latency_us ? 31 - __builtin_clz(latency_us) : 0;
+    hist[b < MAC_STATS_BINS ? b : MAC_STATS_BINS - 1]++;
+    analyzed++;
+  }
+
+  void occupancy(uint32_t waiting) {
+    if (waiting > maxwaiting)
+      maxwaiting = waiting;
+  }
+
+  // latency [us] below which <pct> percent of recorded MACs were analyzed
+  uint32_t percentile(uint8_t pct) const {
+    uint32_t total = 0, sum = 0;
+    for (uint8_t i = 0; i < MAC_STATS_BINS; i++)
+      total += hist[i];
+    if (!total)
+      return 0;
+    const uint32_t rank = (uint64_t)total * pct / 100;
+    for (uint8_t i = 0; i < MAC_STATS_BINS; i++) {
+      sum += hist[i];
+      if (sum > rank || sum == total)
+        return (2UL << i) - 1;
+    }
+    return UINT32_MAX;
+  }
+
+  uint32_t count(void) const { return analyzed; }   // since boot
+  uint32_t peak(void) const { return maxwaiting; } // since clear
+
+  // clears histogram and peak, keeps analyzed counter
+  void clear(void) {
+    memset(hist, 0, sizeof(hist));
+    maxwaiting = 0;
+  }
+
+private:
+  uint32_t hist[MAC_STATS_BINS];
+  uint32_t analyzed;
+  uint32_t maxwaiting;
+};
+
+#endif
@@ -4,18 +4,50 @@
 #include "globals.h"
 #include "rcommand.h"
 #include "hash.h"
+#include "payload.h"
+#include "mqttoutbox.h"
 #include <MQTT.h>
 #include <ETH.h>
-#include <mbedtls/base64.h>
 
 #ifndef MQTT_CLIENTNAME
 #define MQTT_CLIENTNAME clientId
 #endif
 
+#ifndef MQTT_QOS
+#define MQTT_QOS 0
+#endif
+
+#ifndef MQTT_BATCH_SIZE
+#define MQTT_BATCH_SIZE 0
+#endif
+
+#ifndef MQTT_FORMAT
+#define MQTT_FORMAT MQTT_FORMAT_BASE64
+#endif
+
+// one message per publish, unless batching is configured
+#if (MQTT_BATCH_SIZE)
+#if (MQTT_BATCH_SIZE < MQTT_ENCODED_MAX(PAYLOAD_BUFFER_SIZE))
+#error MQTT_BATCH_SIZE must hold one encoded payload
+#endif
+#define MQTT_PAYLOAD_SIZE MQTT_BATCH_SIZE
+#define MQTT_BATCH_MAX 32 // max. number of messages per publish
+#else
+#define MQTT_PAYLOAD_SIZE MQTT_ENCODED_MAX(PAYLOAD_BUFFER_SIZE)
+#define MQTT_BATCH_MAX 1
+#endif
+
+#define MQTT_INTOPIC_RAW MQTT_INTOPIC "/raw" // downlinks without base64
+
+#define MQTT_RETRY_MIN_MS 1000 // first reconnect attempt, doubled up to MQTT_RETRYSEC
+
+typedef MqttOutbox<MessageBuffer_t, SEND_QUEUE_SIZE> MqttOutbox_t;
+
 extern TaskHandle_t mqttTask;
 
 void mqtt_enqueuedata(MessageBuffer_t *message);
 uint32_t mqtt_queuewaiting(void);
+bool mqtt_queueready(uint8_t port);
 void mqtt_queuereset(void);
 void mqtt_client_task(void *param);
 int mqtt_connect(const char *my_host, const uint16_t my_port);
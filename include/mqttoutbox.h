@@ -0,0 +1,102 @@
+#ifndef _MQTTOUTBOX_H
+#define _MQTTOUTBOX_H
+
+// Outbox of the MQTT client. Messages are moved from the MQTT send queue into
+// the outbox and stay there until their publish succeeded, so they outlast a
+// lost connection. When the outbox is full, its oldest message is dropped.
+//
+// The oldest message and the following messages of the same port are
+// published together as one batch on topic <MQTT_OUTTOPIC>/<port>, in the
+// wire format of the port:
+//
+//   base64  base64 of each message, separated by newline
+//   raw     message, or [size][message] for each message if batching
+//   json    JSON object of each message (payloadjson.h), separated by newline
+//
+// A base64 batch of one message is the same payload as sent before batching.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "base64codec.h"
+#include "payloadjson.h"
+#include "prioqueue.h"
+
+#define MQTT_FORMAT_BASE64 0
+#define MQTT_FORMAT_RAW 1
+#define MQTT_FORMAT_JSON 2
+
+#define MQTT_BATCH_SEPARATOR '\n'
+
+// longest encoding of a message of n bytes, {"port":255,"bytes":"<base64>"}
+#define MQTT_ENCODED_MAX(n) (24 + 4 * (((n) + 2) / 3))
+
+template <class T, uint32_t N> using MqttOutbox = PrioQueue<T *, 1, N>;
+
+// writes message in wire format to out, after a separator unless first of
+// batch. Raw messages are prefixed by their size only if batched is set, i.e.
+// publishes may carry more than one message. Returns number of characters,
+// or 0 if it does not fit into size.
+// schemas selects JSON rendering of fields, else JSON holds base64 only, as
+// it does for a first message whose fields do not fit.
+template <bool MSB, class T>
+static uint16_t mqtt_encode(const T *msg, uint8_t format, bool first,
+                            bool batched, char *out, uint16_t size,
+                            bool schemas = true) {
+  uint16_t const sep = (first || format == MQTT_FORMAT_RAW) ? 0 : 1;
+  uint16_t n;
+
+  if (sep >= size)
+    return 0;
+  switch (format) {
+  case MQTT_FORMAT_RAW:
+    n = batched ? 1 : 0;
+    if (n + msg->MessageSize > size)
+      return 0;
+    if (batched)
+      out[0] = msg->MessageSize;
+    memcpy(out + n, msg->Message, msg->MessageSize);
+    return n + msg->MessageSize;
+  case MQTT_FORMAT_JSON:
+    n = payload_json<MSB>(msg->MessagePort, msg->Message, msg->MessageSize,
+                          out + sep, size - sep, schemas);
+    if (!n && first)
+      n = payload_json<MSB>(msg->MessagePort, msg->Message, msg->MessageSize,
+                            out, size, false);
+    break;
+  default:
+    if (base64_len(msg->MessageSize) > size - sep)
+      return 0;
+    n = base64_put(out + sep, msg->Message, msg->MessageSize);
+  }
+  if (n && sep)
+    out[0] = MQTT_BATCH_SEPARATOR;
+  return n ? sep + n : 0;
+}
+
+// collects up to max messages of outbox into batch and encodes them with
+// encode(msg, first, out, size) into payload of size bytes. Returns number of
+// messages, payload length is stored in len.
+template <class Q, class T, class E>
+static uint8_t mqtt_batch(const Q &outbox, T **batch, uint8_t max,
+                          char *payload, uint16_t size, uint16_t *len,
+                          E encode) {
+  uint8_t n = 0;
+  uint16_t used = 0;
+
+  outbox.each([&](T *msg) {
+    if (n && msg->MessagePort != batch[0]->MessagePort)
+      return true; // other topic, goes into a later batch
+    uint16_t const written = encode(msg, !n, payload + used, size - used);
+    if (!written)
+      return false; // keep order within topic
+    used += written;
+    batch[n++] = msg;
+    return n < max;
+  });
+
+  *len = used;
+  return n;
+}
+
+#endif
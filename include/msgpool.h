@@ -0,0 +1,63 @@
+#ifndef _MSGPOOL_H
+#define _MSGPOOL_H
+
+// Fixed-size pool of reference counted message buffers.
+// One buffer is taken per payload and its pointer is handed to every send
+// queue. Each transport calls release() when it is done with the message, the
+// last release() returns the buffer to the pool. alloc() and release() are
+// lock-free and may be called from any task.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <class T, uint32_t N> class MsgPool {
+
+public:
+  MsgPool() : misses(0) {
+    for (uint32_t i = 0; i < N; i++)
+      refs[i].store(0, std::memory_order_relaxed);
+  }
+
+  // returns a free buffer owned by refcnt users, or NULL if pool is exhausted
+  T *alloc(uint8_t refcnt) {
+    for (uint32_t i = 0; i < N; i++) {
+      uint8_t expected = 0;
+      if (refs[i].compare_exchange_strong(expected, refcnt,
+                                          std::memory_order_acquire))
+        return &buf[i];
+    }
+    misses++;
+    return NULL;
+  }
+
+  // adds a user to a buffer already owned by the caller
+  void retain(T *item) {
+    refs[item - buf].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // drops one user, buffer is free again when the last user released it
+  void release(T *item) {
+    if (item)
+      refs[item - buf].fetch_sub(1, std::memory_order_release);
+  }
+
+  uint32_t in_use(void) const {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < N; i++)
+      if (refs[i].load(std::memory_order_relaxed))
+        n++;
+    return n;
+  }
+
+  uint32_t exhausted(void) const { return misses; }
+
+  static constexpr uint32_t capacity(void) { return N; }
+
+private:
+  T buf[N];
+  std::atomic<uint8_t> refs[N];
+  volatile uint32_t misses;
+};
+
+#endif
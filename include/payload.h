@@ -2,10 +2,20 @@
 #define _PAYLOAD_H_
 
 #include "sds011read.h"
+#include "payloadschema.h"
+
+// byte order of schema based formats, plain is MSB first, packed LSB first
+#if ((PAYLOAD_ENCODER < 1) || (PAYLOAD_ENCODER > 4))
+#error No valid payload converter defined!
+#elif (PAYLOAD_ENCODER == 2)
+#define PAYLOAD_MSB false
+#else
+#define PAYLOAD_MSB true
+#endif
 
 // MyDevices CayenneLPP 1.0 channels for Synamic sensor payload format
 // all payload goes out on LoRa FPort 1
-#if (PAYLOAD_ENCODER == 3)
+#if ((PAYLOAD_ENCODER == 3) || (PAYLOAD_ENCODER == 4))
 
 #define LPP_GPS_CHANNEL 20
 #define LPP_COUNT_WIFI_CHANNEL 21
@@ -21,6 +31,11 @@
 #define LPP_AIR_CHANNEL 31
 #define LPP_PARTMATTER10_CHANNEL 32    // particular matter for PM 10
 #define LPP_PARTMATTER25_CHANNEL 33    // particular matter for PM 2.5
+#define LPP_WINDOW_SHORT_CHANNEL 34    // sliding window count, short
+#define LPP_WINDOW_MID_CHANNEL 35      // sliding window count, mid
+#define LPP_WINDOW_LONG_CHANNEL 36     // sliding window count, long
+#define LPP_PIPELINE_WIFI_CHANNEL 37   // p99 MAC processing latency, wifi
+#define LPP_PIPELINE_BLE_CHANNEL 38    // p99 MAC processing latency, ble
 
 // MyDevices CayenneLPP 2.0 types for Packed Sensor Payload, not using channels,
 // but different FPorts
@@ -47,10 +62,12 @@ public:
   uint8_t *getBuffer(void);
   void addByte(uint8_t value);
   void addCount(uint16_t value, uint8_t sniffytpe);
+  void addWindow(uint16_t shortcount, uint16_t midcount, uint16_t longcount);
   void addConfig(configData_t value);
   void addStatus(uint16_t voltage, uint64_t uptime, float cputemp, uint32_t mem,
                  uint8_t reset0, uint32_t restarts);
   void addAlarm(int8_t rssi, uint8_t message);
+  void addPipeline(pipelineStatus_t wifi, pipelineStatus_t ble);
   void addVoltage(uint16_t value);
   void addGPS(gpsStatus_t value);
   void addBME(bmeStatus_t value);
@@ -58,44 +75,19 @@ public:
   void addSensor(uint8_t[]);
   void addTime(time_t value);
   void addSDS(sdsStatus_t value);
-private:
-  void addChars( char* string, int len);
-
-#if (PAYLOAD_ENCODER == 1) // format plain
-
-private:
-  uint8_t *buffer;
-  uint8_t cursor;
-
-#elif (PAYLOAD_ENCODER == 2) // format packed
-
-private:
-  uint8_t *buffer;
-  uint8_t cursor;
-  void uintToBytes(uint64_t i, uint8_t byteSize);
-  void writeUptime(uint64_t unixtime);
-  void writeLatLng(double latitude, double longitude);
-  void writeUint64(uint64_t i);
-  void writeUint32(uint32_t i);
-  void writeUint16(uint16_t i);
-  void writeUint8(uint8_t i);
-  void writeFloat(float value);
-  void writeUFloat(float value);
-  void writePressure(float value);
-  void writeVersion(char *version);
-  void writeBitmap(bool a, bool b, bool c, bool d, bool e, bool f, bool g,
-                   bool h);
-
-#elif ((PAYLOAD_ENCODER == 3) || (PAYLOAD_ENCODER == 4)) // format cayenne lpp
-
 private:
   uint8_t *buffer;
   uint8_t maxsize;
   uint8_t cursor;
-
-#else
-#error No valid payload converter defined!
-#endif
+  uint8_t *reserve(uint8_t size);
+  void addChars(char *string, int len);
+
+  // appends a record of one value per field of schema S
+  template <class S, class... V> void writeSchema(V... values) {
+    uint8_t *p = reserve(S::size);
+    if (p)
+      S::template encode<PAYLOAD_MSB>(p, values...);
+  }
 };
 
 extern PayloadConvert payload;
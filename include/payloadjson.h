@@ -0,0 +1,149 @@
+#ifndef _PAYLOADJSON_H
+#define _PAYLOADJSON_H
+
+// Compact JSON rendering of plain and packed payloads, one object per
+// message, e.g. {"port":1,"wifi":12,"ble":5}. Layouts are matched by port and
+// length and read by the schemas of payloadschema.h, fields are named as in
+// TTN decoders and hold the integer values as sent, unscaled. Payloads of
+// other layouts, or of LPP encoders, are rendered as
+// {"port":10,"bytes":"<base64>"}. Rendering is single pass into the buffer of
+// the caller. Port numbers are taken from paxcounter.conf.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "base64codec.h"
+#include "payloadschema.h"
+
+class JsonOut {
+
+public:
+  JsonOut(char *buffer, uint16_t size)
+      : start(buffer), p(buffer), end(buffer + size), ok(true) {}
+
+  void put(const char *s, uint16_t n) {
+    if (!ok || n > end - p) {
+      ok = false;
+      return;
+    }
+    memcpy(p, s, n);
+    p += n;
+  }
+
+  void put(const char *s) { put(s, strlen(s)); }
+
+  void key(const char *name) {
+    put(",\"");
+    put(name);
+    put("\":");
+  }
+
+  void number(uint64_t v, bool negative = false) {
+    char digits[21], *d = digits + sizeof(digits);
+    do {
+      *--d = '0' + v % 10;
+      v /= 10;
+    } while (v);
+    if (negative)
+      *--d = '-';
+    put(d, digits + sizeof(digits) - d);
+  }
+
+  void number(int64_t v) { number(v < 0 ? -(uint64_t)v : (uint64_t)v, v < 0); }
+
+  void base64(const uint8_t *data, uint16_t n) {
+    if (!ok || base64_len(n) > end - p) {
+      ok = false;
+      return;
+    }
+    p += base64_put(p, data, n);
+  }
+
+  // number of characters written, 0 if buffer was too small
+  uint16_t length(void) const { return ok ? p - start : 0; }
+
+private:
+  char *start, *p, *end;
+  bool ok;
+};
+
+// writes fields of a schema as JSON members
+template <bool MSB> struct PayloadJsonFields {
+  const uint8_t *p;
+  JsonOut &out;
+
+  template <class F> void field(void) {
+    typename F::type const v = F::template get<MSB>(p);
+    p += F::size;
+    out.key(F::name());
+    if (F::is_signed)
+      out.number((int64_t)v);
+    else
+      out.number((uint64_t)v);
+  }
+};
+
+template <uint8_t P, class S> struct PayloadLayout {};
+
+// list of layouts, render() writes fields of the first one matching
+template <class... L> struct PayloadLayouts;
+
+template <> struct PayloadLayouts<> {
+  template <bool MSB>
+  static bool render(uint8_t, const uint8_t *, uint8_t, JsonOut &) {
+    return false;
+  }
+};
+
+template <uint8_t P, class S, class... R>
+struct PayloadLayouts<PayloadLayout<P, S>, R...> {
+  template <bool MSB>
+  static bool render(uint8_t port, const uint8_t *p, uint8_t size,
+                     JsonOut &out) {
+    if (port != P || size != S::size)
+      return PayloadLayouts<R...>::template render<MSB>(port, p, size, out);
+    PayloadJsonFields<MSB> fields{p, out};
+    S::visit(fields);
+    return true;
+  }
+};
+
+// payloads as sent on each port, told apart by length as in TTN decoders
+typedef PayloadLayouts<
+    PayloadLayout<COUNTERPORT, CountSchema>,
+    PayloadLayout<COUNTERPORT,
+                  PayloadSchema<PayloadField::wifi, PayloadField::ble>>,
+    PayloadLayout<COUNTERPORT, PayloadSchema<PayloadField::wifi, GpsSchema>>,
+    PayloadLayout<COUNTERPORT, PayloadSchema<PayloadField::wifi,
+                                             PayloadField::ble, GpsSchema>>,
+    PayloadLayout<STATUSPORT, StatusSchema>,
+    PayloadLayout<STATUSPORT,
+                  PayloadSchema<WifiPipelineSchema, BlePipelineSchema>>,
+    PayloadLayout<GPSPORT, GpsSchema>, PayloadLayout<BUTTONPORT, ButtonSchema>,
+    PayloadLayout<BEACONPORT, AlarmSchema>,
+    PayloadLayout<BATTPORT, VoltageSchema>,
+    PayloadLayout<TIMEPORT, PayloadSchema<TimeSchema, PayloadField::timestatus>>,
+    PayloadLayout<SENSOR1PORT, PayloadSchema<PayloadField::ens>>,
+    PayloadLayout<WINDOWPORT, WindowSchema>>
+    PayloadJsonLayouts;
+
+// renders one payload as JSON object, returns number of characters written,
+// or 0 if it does not fit into size
+template <bool MSB>
+static uint16_t payload_json(uint8_t port, const uint8_t *payload,
+                             uint8_t len, char *out, uint16_t size,
+                             bool schemas = true) {
+  JsonOut json(out, size);
+  json.put("{\"port\":");
+  json.number((uint64_t)port);
+  if (!schemas ||
+      !PayloadJsonLayouts::template render<MSB>(port, payload, len, json)) {
+    json.put(",\"bytes\":\"");
+    json.base64(payload, len);
+    json.put("\"");
+  }
+  json.put("}");
+  return json.length();
+}
+
+#endif
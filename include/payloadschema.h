@@ -0,0 +1,205 @@
+#ifndef _PAYLOADSCHEMA_H
+#define _PAYLOADSCHEMA_H
+
+// Compile time description of payload layouts for plain and packed encoder.
+// A schema is a list of named fields of fixed wire size. Plain format writes
+// each field MSB first, packed format LSB first, otherwise both are the same,
+// so one schema serves both encoders. Offsets and byte order are resolved at
+// compile time, encode() compiles to plain stores.
+// tools/schemagen prints TTN decoders from the same schemas and checks
+// encode -> decode round trips.
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// byte I to N-1 of an integer, unrolled at compile time
+template <uint8_t N, bool MSB, uint8_t I = 0> struct PayloadBytes {
+  static void put(uint8_t *p, uint64_t value) {
+    p[MSB ? N - 1 - I : I] = (uint8_t)(value >> (8 * I));
+    PayloadBytes<N, MSB, I + 1>::put(p, value);
+  }
+
+  static uint64_t get(const uint8_t *p) {
+    return (uint64_t)p[MSB ? N - 1 - I : I] << (8 * I) |
+           PayloadBytes<N, MSB, I + 1>::get(p);
+  }
+};
+
+template <uint8_t N, bool MSB> struct PayloadBytes<N, MSB, N> {
+  static void put(uint8_t *, uint64_t) {}
+  static uint64_t get(const uint8_t *) { return 0; }
+};
+
+// reverses byte order of a native integer
+static inline uint8_t payload_swap(uint8_t v) { return v; }
+static inline uint16_t payload_swap(uint16_t v) { return __builtin_bswap16(v); }
+static inline uint32_t payload_swap(uint32_t v) { return __builtin_bswap32(v); }
+static inline uint64_t payload_swap(uint64_t v) { return __builtin_bswap64(v); }
+
+// unsigned or signed integer of N bytes. On little endian hosts (ESP32) a
+// native width is byte swapped for MSB first and copied in one go, other
+// widths are written byte by byte.
+template <class T, uint8_t N> struct PayloadInt {
+  typedef T type;
+  static const uint8_t size = N;
+  static const bool is_signed = (T)-1 < (T)0;
+
+  template <bool MSB> static void put(uint8_t *p, T value) {
+#if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    if (N == sizeof(T)) {
+      typedef typename std::make_unsigned<T>::type U;
+      U v = MSB ? payload_swap((U)value) : (U)value;
+      memcpy(p, &v, N);
+      return;
+    }
+#endif
+    PayloadBytes<N, MSB>::put(p, (uint64_t)value);
+  }
+
+  template <bool MSB> static T get(const uint8_t *p) {
+    return (T)PayloadBytes<N, MSB>::get(p);
+  }
+};
+
+// integer MSB first in any format, as packed temperature (lora-serialization)
+template <class T, uint8_t N> struct PayloadIntMSB : PayloadInt<T, N> {
+  template <bool MSB> static void put(uint8_t *p, T value) {
+    PayloadInt<T, N>::template put<true>(p, value);
+  }
+
+  template <bool MSB> static T get(const uint8_t *p) {
+    return PayloadInt<T, N>::template get<true>(p);
+  }
+};
+
+// N characters, e.g. version string, not zero terminated if N are used
+template <uint8_t N> struct PayloadChars {
+  typedef const char *type;
+  static const uint8_t size = N;
+
+  template <bool MSB> static void put(uint8_t *p, const char *value) {
+    memcpy(p, value, N);
+  }
+};
+
+typedef PayloadInt<uint8_t, 1> PayloadUint8;
+typedef PayloadInt<int8_t, 1> PayloadInt8;
+typedef PayloadInt<uint16_t, 2> PayloadUint16;
+typedef PayloadInt<int16_t, 2> PayloadInt16;
+typedef PayloadInt<uint32_t, 4> PayloadUint32;
+typedef PayloadInt<int32_t, 4> PayloadInt32;
+typedef PayloadInt<uint64_t, 8> PayloadUint64;
+
+// field named as in TTN decoders, jstype is the decoder function used by the
+// packed TTN decoder (lora-serialization)
+#define PAYLOAD_FIELD(id, wire, jstype)                                        \
+  struct id : wire {                                                           \
+    static const char *name(void) { return #id; }                              \
+    static const char *js(void) { return #jstype; }                            \
+    template <class V> static void visit(V &visitor) {                         \
+      visitor.template field<id>();                                            \
+    }                                                                          \
+  }
+
+// list of fields, may also contain schemas to describe composed layouts,
+// encode() and decode() take one value per field
+template <class... F> struct PayloadSchema;
+
+template <> struct PayloadSchema<> {
+  static const uint8_t size = 0;
+  template <bool MSB> static void encode(uint8_t *) {}
+  template <bool MSB> static void decode(const uint8_t *) {}
+  template <class V> static void visit(V &) {}
+};
+
+template <class F, class... R> struct PayloadSchema<F, R...> {
+  static const uint8_t size = F::size + PayloadSchema<R...>::size;
+
+  template <bool MSB, class T, class... V>
+  static void encode(uint8_t *p, T value, V... rest) {
+    F::template put<MSB>(p, value);
+    PayloadSchema<R...>::template encode<MSB>(p + F::size, rest...);
+  }
+
+  template <bool MSB, class T, class... V>
+  static void decode(const uint8_t *p, T &value, V &...rest) {
+    value = F::template get<MSB>(p);
+    PayloadSchema<R...>::template decode<MSB>(p + F::size, rest...);
+  }
+
+  template <class V> static void visit(V &visitor) {
+    F::visit(visitor);
+    PayloadSchema<R...>::visit(visitor);
+  }
+};
+
+namespace PayloadField {
+PAYLOAD_FIELD(wifi, PayloadUint16, uint16);
+PAYLOAD_FIELD(ble, PayloadUint16, uint16);
+PAYLOAD_FIELD(ens, PayloadUint16, uint16);
+PAYLOAD_FIELD(window_short, PayloadUint16, uint16);
+PAYLOAD_FIELD(window_mid, PayloadUint16, uint16);
+PAYLOAD_FIELD(window_long, PayloadUint16, uint16);
+PAYLOAD_FIELD(latitude, PayloadInt32, latLng);
+PAYLOAD_FIELD(longitude, PayloadInt32, latLng);
+PAYLOAD_FIELD(sats, PayloadUint8, uint8);
+PAYLOAD_FIELD(hdop, PayloadUint16, hdop);
+PAYLOAD_FIELD(altitude, PayloadInt16, altitude);
+PAYLOAD_FIELD(voltage, PayloadUint16, uint16);
+PAYLOAD_FIELD(uptime, PayloadUint64, uptime);
+PAYLOAD_FIELD(cputemp, PayloadUint8, uint8);
+PAYLOAD_FIELD(memory, PayloadUint32, uint32);
+PAYLOAD_FIELD(reset0, PayloadUint8, uint8);
+PAYLOAD_FIELD(restarts, PayloadUint32, uint32);
+PAYLOAD_FIELD(wifi_analyzed, PayloadUint32, uint32);
+PAYLOAD_FIELD(wifi_dropped, PayloadUint32, uint32);
+PAYLOAD_FIELD(wifi_filtered, PayloadUint32, uint32);
+PAYLOAD_FIELD(wifi_p50, PayloadUint16, uint16);
+PAYLOAD_FIELD(wifi_p99, PayloadUint16, uint16);
+PAYLOAD_FIELD(wifi_peak, PayloadUint8, uint8);
+PAYLOAD_FIELD(ble_analyzed, PayloadUint32, uint32);
+PAYLOAD_FIELD(ble_dropped, PayloadUint32, uint32);
+PAYLOAD_FIELD(ble_filtered, PayloadUint32, uint32);
+PAYLOAD_FIELD(ble_p50, PayloadUint16, uint16);
+PAYLOAD_FIELD(ble_p99, PayloadUint16, uint16);
+PAYLOAD_FIELD(ble_peak, PayloadUint8, uint8);
+PAYLOAD_FIELD(button, PayloadUint8, uint8);
+PAYLOAD_FIELD(rssi, PayloadInt8, int8);
+PAYLOAD_FIELD(beacon, PayloadUint8, uint8);
+PAYLOAD_FIELD(time, PayloadUint32, uint32);
+PAYLOAD_FIELD(timestatus, PayloadUint8, uint8);
+} // namespace PayloadField
+
+// schemas written by PayloadConvert, wifi, ble and ens counts are alike
+typedef PayloadSchema<PayloadField::wifi> CountSchema;
+typedef PayloadSchema<PayloadField::window_short, PayloadField::window_mid,
+                      PayloadField::window_long>
+    WindowSchema;
+typedef PayloadSchema<PayloadField::rssi, PayloadField::beacon> AlarmSchema;
+typedef PayloadSchema<PayloadField::wifi_analyzed, PayloadField::wifi_dropped,
+                      PayloadField::wifi_filtered, PayloadField::wifi_p50,
+                      PayloadField::wifi_p99, PayloadField::wifi_peak>
+    WifiPipelineSchema;
+typedef PayloadSchema<PayloadField::ble_analyzed, PayloadField::ble_dropped,
+                      PayloadField::ble_filtered, PayloadField::ble_p50,
+                      PayloadField::ble_p99, PayloadField::ble_peak>
+    BlePipelineSchema;
+typedef PayloadSchema<PayloadField::voltage> VoltageSchema;
+typedef PayloadSchema<PayloadField::voltage, PayloadField::uptime,
+                      PayloadField::cputemp, PayloadField::memory,
+                      PayloadField::reset0, PayloadField::restarts>
+    StatusSchema;
+#if (PAYLOAD_OPENSENSEBOX)
+typedef PayloadSchema<PayloadField::latitude, PayloadField::longitude>
+    GpsSchema;
+#else
+typedef PayloadSchema<PayloadField::latitude, PayloadField::longitude,
+                      PayloadField::sats, PayloadField::hdop,
+                      PayloadField::altitude>
+    GpsSchema;
+#endif
+typedef PayloadSchema<PayloadField::button> ButtonSchema;
+typedef PayloadSchema<PayloadField::time> TimeSchema;
+
+#endif
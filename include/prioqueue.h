@@ -0,0 +1,149 @@
+#ifndef _PRIOQUEUE_H
+#define _PRIOQUEUE_H
+
+// Send queue with C priority classes, class 0 being the most urgent.
+// Each class is a FIFO holding up to its own capacity, all classes together
+// hold up to N items. When a limit is hit, the oldest item of the least urgent
+// class not more urgent than the new item is dropped. Not thread safe, caller
+// must serialize access.
+
+#include <stdint.h>
+
+template <class T, uint8_t C, uint32_t N> class PrioQueue {
+
+public:
+  PrioQueue(const uint32_t (&capacity)[C]) : total(0) {
+    for (uint8_t c = 0; c < C; c++) {
+      cap[c] = (capacity[c] < N) ? capacity[c] : N;
+      count[c] = 0;
+    }
+  }
+
+  // returns true if an item was dropped to keep limits, dropped item is
+  // stored in evicted and may be item itself
+  bool push(const T &item, uint8_t prio, T &evicted) {
+    bool drop = false;
+    if (prio >= C)
+      prio = C - 1;
+    if (count[prio] >= cap[prio]) {
+      // class full -> drop its oldest item
+      if (!cap[prio]) {
+        evicted = item;
+        return true;
+      }
+      evicted = take(prio, 0);
+      drop = true;
+    } else if (total >= N) {
+      // queue full -> drop oldest item of least urgent class up to ours
+      uint8_t c = C - 1;
+      while (c > prio && !count[c])
+        c--;
+      if (!count[c]) {
+        evicted = item;
+        return true;
+      }
+      evicted = take(c, 0);
+      drop = true;
+    }
+    items[prio][count[prio]++] = item;
+    total++;
+    return drop;
+  }
+
+  // most urgent item, without removing it
+  bool peek(T &item) const {
+    for (uint8_t c = 0; c < C; c++)
+      if (count[c]) {
+        item = items[c][0];
+        return true;
+      }
+    return false;
+  }
+
+  // removes and returns most urgent item
+  bool pop(T &item) {
+    for (uint8_t c = 0; c < C; c++)
+      if (count[c]) {
+        item = take(c, 0);
+        return true;
+      }
+    return false;
+  }
+
+  bool contains(const T &item) const {
+    for (uint8_t c = 0; c < C; c++)
+      for (uint32_t i = 0; i < count[c]; i++)
+        if (items[c][i] == item)
+          return true;
+    return false;
+  }
+
+  // newest queued item for which match(item) is true
+  template <class F> bool find(F match, T &item) const {
+    for (uint8_t c = 0; c < C; c++)
+      for (uint32_t i = count[c]; i-- > 0;)
+        if (match(items[c][i])) {
+          item = items[c][i];
+          return true;
+        }
+    return false;
+  }
+
+  // calls f(item) for items from most urgent and oldest on, until f returns
+  // false
+  template <class F> void each(F f) const {
+    for (uint8_t c = 0; c < C; c++)
+      for (uint32_t i = 0; i < count[c]; i++)
+        if (!f(items[c][i]))
+          return;
+  }
+
+  // puts newitem in place of olditem, returns false if olditem is not queued
+  bool replace(const T &olditem, const T &newitem) {
+    for (uint8_t c = 0; c < C; c++)
+      for (uint32_t i = 0; i < count[c]; i++)
+        if (items[c][i] == olditem) {
+          items[c][i] = newitem;
+          return true;
+        }
+    return false;
+  }
+
+  // removes a given item, returns false if it is no longer queued
+  bool remove(const T &item) {
+    for (uint8_t c = 0; c < C; c++)
+      for (uint32_t i = 0; i < count[c]; i++)
+        if (items[c][i] == item) {
+          take(c, i);
+          return true;
+        }
+    return false;
+  }
+
+  uint32_t waiting(void) const { return total; }
+
+  uint32_t waiting(uint8_t prio) const { return count[prio]; }
+
+  // true if an item of class prio is taken without dropping another one
+  bool room(uint8_t prio) const {
+    if (prio >= C)
+      prio = C - 1;
+    return count[prio] < cap[prio] && total < N;
+  }
+
+  static constexpr uint32_t capacity(void) { return N; }
+
+private:
+  T items[C][N];
+  uint32_t cap[C], count[C], total;
+
+  T take(uint8_t c, uint32_t i) {
+    T item = items[c][i];
+    for (count[c]--; i < count[c]; i++)
+      items[c][i] = items[c][i + 1];
+    total--;
+    return item;
+  }
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <globals.h>
 #include <stdio.h>
 #include <SPI.h>
+#include "sdlog.h"
 
 #if (HAS_SDCARD)
 #if HAS_SDCARD == 1
@@ -54,7 +55,32 @@
 #define SDCARD_DATA3 13
 #endif
 
-#define SDCARD_FILE_NAME "/paxcount.%02d"
+#ifndef SDCARD_FORMAT
+#define SDCARD_FORMAT 0 // 0 = CSV, 1 = binary, see sdlog.h
+#endif
+
+#ifndef SDCARD_SYNC_SEC
+#define SDCARD_SYNC_SEC 60 // about one send cycle of data at risk
+#endif
+
+#ifndef SDCARD_FILE_KB
+#define SDCARD_FILE_KB 4096
+#endif
+
+#ifndef SDCARD_FILE_DAILY
+#define SDCARD_FILE_DAILY 1
+#endif
+
+#define SDCARD_BUFFER_SECTORS 8 // RAM buffer, 4 KB
+#define SDCARD_FILE_COUNT 99999  // file numbers wrap after this
+
+#if (SDCARD_FORMAT == 1)
+#define SDCARD_FILE_NAME "/pax%05u.bin"
+#else
+#define SDCARD_FILE_NAME "/pax%05u.csv"
+#endif
+#define SDCARD_INDEX_NAME "/paxcount.idx"
+#define SDCARD_PROBE_NAME "/paxprobe.tmp" // scratch file of write check
 #define SDCARD_FILE_HEADER "date, time, wifi, bluet"
 
 #if (COUNT_ENS)
@@ -62,6 +88,7 @@
 #endif
 
 bool sdcard_init(void);
+void sdcard_flush(void);
 void sdcardWriteData(uint16_t, uint16_t, uint16_t = 0);
 
 #endif // _SDCARD_H
@@ -0,0 +1,201 @@
+#ifndef _SDLOG_H
+#define _SDLOG_H
+
+// Buffered log file on SD-card. Data is collected in a RAM block of SECTORS
+// sectors and written when the block is full, so the card sees whole aligned
+// sectors. flush() writes out the partial sector as well and syncs, it stays
+// in RAM and the next write starts over at its begin, so every write starts
+// sector aligned.
+//
+// Logs hold either CSV text, or binary records. In binary logs each sector of
+// 512 bytes starts with
+//
+//   [magic 'P' 'X'][flags][version]
+//
+// followed by records [len][len bytes], which never span sectors. A len of 0
+// pads to the end of the sector. flags tell the fields of all records of the
+// sector, each record is
+//
+//   [time 4][wifi 2][ble 2][cwa 2][pm10 2][pm25 2]
+//
+// LSB first, where cwa is present with SDLOG_CWA, pm10 and pm25 with
+// SDLOG_SDS011. time is local time in seconds since 1970, pm values are in
+// 0.1 ug/m3. A reader skips sectors without magic, tools/sdlog2csv converts
+// logs to CSV.
+//
+// W provides write(pos, data, len), writing at file offset pos, which is the
+// end of the file or, unless appendonly() was set, the begin of its last,
+// partial sector, and returning true on success, and sync(), which writes
+// through to the card and returns true if all writes since the last sync
+// made it.
+
+#include <stdint.h>
+#include <string.h>
+
+#define SDLOG_SECTOR 512
+#define SDLOG_SECTOR_HEADER 4
+#define SDLOG_VERSION 1
+
+// fields of records
+#define SDLOG_CWA 0x01
+#define SDLOG_SDS011 0x02
+
+typedef struct {
+  uint32_t time;
+  uint16_t wifi, ble, cwa, pm10, pm25;
+} SdLogRecord_t;
+
+// writes record as laid out by flags to p, returns its length
+static inline uint8_t sdlog_encode(uint8_t *p, const SdLogRecord_t &r,
+                                   uint8_t flags) {
+  uint16_t v[5] = {r.wifi, r.ble, r.cwa, r.pm10, r.pm25};
+  uint8_t n = 0, i;
+  for (i = 0; i < 4; i++)
+    p[n++] = r.time >> (8 * i);
+  for (i = 0; i < 5; i++) {
+    if ((i == 2 && !(flags & SDLOG_CWA)) || (i > 2 && !(flags & SDLOG_SDS011)))
+      continue;
+    p[n++] = v[i] & 0xff;
+    p[n++] = v[i] >> 8;
+  }
+  return n;
+}
+
+// reads record of len bytes as laid out by flags, returns false if too short
+static inline bool sdlog_decode(const uint8_t *p, uint8_t len,
+                                SdLogRecord_t &r, uint8_t flags) {
+  uint16_t *v[5] = {&r.wifi, &r.ble, &r.cwa, &r.pm10, &r.pm25};
+  uint8_t n = 4, i;
+  memset(&r, 0, sizeof(r));
+  if (len < n)
+    return false;
+  r.time = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+  for (i = 0; i < 5; i++) {
+    if ((i == 2 && !(flags & SDLOG_CWA)) || (i > 2 && !(flags & SDLOG_SDS011)))
+      continue;
+    if (n + 2 > len)
+      return false;
+    *v[i] = p[n] | p[n + 1] << 8;
+    n += 2;
+  }
+  return true;
+}
+
+// calls record(flags, data, len) for each record of a binary sector of len
+// bytes, which is the last one of a file if shorter than a sector. Returns
+// number of records, or -1 if sector has no header.
+template <class F>
+static int sdlog_parse(const uint8_t *sector, uint16_t len, F record) {
+  uint16_t i = SDLOG_SECTOR_HEADER;
+  int n = 0;
+  if (len < SDLOG_SECTOR_HEADER || sector[0] != 'P' || sector[1] != 'X')
+    return -1;
+  while (i < len && sector[i] && 1 + sector[i] <= len - i) {
+    record(sector[2], sector + i + 1, sector[i]);
+    i += 1 + sector[i];
+    n++;
+  }
+  return n;
+}
+
+template <class W, uint16_t SECTORS> class SdLog {
+
+public:
+  SdLog(W &out) : out(out), append(false) { start(); }
+
+  // never rewrite data already written, for files opened in append mode
+  void appendonly(bool on) { append = on; }
+
+  // starts at begin of an empty file
+  void start(void) { base = used = written = 0; }
+
+  // appends text, lines may span sectors
+  bool text(const char *s, uint16_t n) {
+    while (n) {
+      uint16_t const k = n < BLOCK - used ? n : BLOCK - used;
+      memcpy(block + used, s, k);
+      used += k;
+      s += k;
+      n -= k;
+      if (used == BLOCK && !spill())
+        return false;
+    }
+    return true;
+  }
+
+  // appends binary record of n bytes with fields as in flags
+  bool record(uint8_t flags, const uint8_t *rec, uint8_t n) {
+    uint16_t off = used % SDLOG_SECTOR;
+    uint8_t *const sector = block + used - off;
+
+    if (1 + n > SDLOG_SECTOR - SDLOG_SECTOR_HEADER)
+      return false;
+    if (off && (1 + n > SDLOG_SECTOR - off || sector[2] != flags)) {
+      memset(block + used, 0, SDLOG_SECTOR - off); // pad, start next sector
+      used += SDLOG_SECTOR - off;
+      if (used == BLOCK && !spill())
+        return false;
+      off = 0;
+    }
+    if (!off) {
+      block[used++] = 'P';
+      block[used++] = 'X';
+      block[used++] = flags;
+      block[used++] = SDLOG_VERSION;
+    }
+    block[used++] = n;
+    memcpy(block + used, rec, n);
+    used += n;
+    return used < BLOCK || spill();
+  }
+
+  // writes all buffered data and syncs, keeps partial sector to append to
+  bool flush(void) {
+    bool ok = write(used);
+    uint16_t const full = used - used % SDLOG_SECTOR;
+    if (full) {
+      memmove(block, block + full, used - full);
+      base += full;
+      used -= full;
+      written -= full;
+    }
+    return out.sync() && ok;
+  }
+
+  // file size, including buffered data
+  uint32_t size(void) const { return base + used; }
+
+  // bytes not yet on card
+  uint32_t pending(void) const { return used - written; }
+
+private:
+  static const uint16_t BLOCK = SECTORS * SDLOG_SECTOR;
+
+  W &out;
+  uint8_t block[BLOCK];
+  uint32_t base;    // file offset of block, sector aligned
+  uint16_t used;    // bytes in block
+  uint16_t written; // bytes of block already written by flush()
+  bool append;      // writes start at end of file
+
+  // writes block up to end, from begin of the sector holding the first byte
+  // not yet written, which rewrites a partial sector written by flush(), or
+  // from that byte in append mode
+  bool write(uint16_t end) {
+    uint16_t const from = append ? written : written - written % SDLOG_SECTOR;
+    bool const ok =
+        end <= written || out.write(base + from, block + from, end - from);
+    written = end;
+    return ok;
+  }
+
+  // writes full block and starts over
+  bool spill(void) {
+    bool const ok = write(BLOCK);
+    base += BLOCK;
+    used = written = 0;
+    return ok;
+  }
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include "lorawan.h"
 #include "display.h"
 #include "sdcard.h"
+#include "spool.h"
 
 
 #if (COUNT_ENS)
@@ -20,6 +21,30 @@
 extern struct count_payload_t count_from_libpax;
 #endif
 
+// number of send queues each payload is handed to, see globals.h
+#define SEND_TRANSPORTS                                                        \
+  (SEND_TRANSPORT_LORA + SEND_TRANSPORT_SPI + SEND_TRANSPORT_MQTT)
+#define SEND_SPOOL_TARGETS                                                     \
+  ((SEND_TRANSPORT_LORA ? SPOOL_LORA : 0) |                                    \
+   (SEND_TRANSPORT_SPI ? SPOOL_SPI : 0) | (SEND_TRANSPORT_MQTT ? SPOOL_MQTT : 0))
+
+// pack all records of a send cycle into as few uplinks as possible
+#ifndef PAYLOAD_AGGREGATE
+#define PAYLOAD_AGGREGATE 0
+#endif
+#define AGGREGATE_HEADER_SIZE 2 // port + length byte per record
+
+// messages too large for current LoRa datarate are sent in fragments
+#define FRAGMENT_HEADER_SIZE 2 // original port + flags/sequence/index byte
+#define FRAGMENT_MAX_INDEX 15
+
+#if (PAYLOAD_AGGREGATE) && (PAYLOAD_ENCODER > 2)
+#error PAYLOAD_AGGREGATE needs plain or packed payload encoder
+#endif
+
+#if (SEND_SPOOL) && !(SEND_TRANSPORTS)
+#error SEND_SPOOL needs LoRa, SPI or MQTT as transport
+#endif
 
 extern Ticker sendTimer;
 
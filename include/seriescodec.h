@@ -0,0 +1,132 @@
+#ifndef _SERIESCODEC_H
+#define _SERIESCODEC_H
+
+// Time series of counter samples, as sent on SERIESPORT.
+//
+// raw:   [n][sample 1][sample 2]...[sample k]
+// delta: [0x80 | n][sample 1][deltas 2]...[deltas k]
+//
+// n is the length of one sample in bytes, samples are oldest first. In delta
+// format a sample is read as n/2 16 bit counts, and each following sample is
+// stored as one zig-zag varint per count, holding the difference to the same
+// count of the sample before. Small changes of counts between send cycles so
+// take one byte per count instead of two.
+
+#include <stdint.h>
+#include <string.h>
+
+#define SERIES_DELTA_FLAG 0x80
+#define SERIES_MAX_COUNTS 8
+
+// zig-zag maps signed to unsigned, small magnitudes to small values
+static inline uint32_t zigzag_encode(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// writes v as little endian base 128 varint, returns number of bytes
+static inline uint8_t varint_put(uint8_t *p, uint32_t v) {
+  uint8_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+// reads varint of at most len bytes, returns number of bytes or 0 if truncated
+static inline uint8_t varint_get(const uint8_t *p, uint8_t len, uint32_t *v) {
+  uint32_t value = 0;
+  for (uint8_t n = 0; n < len && n < 5; n++) {
+    value |= (uint32_t)(p[n] & 0x7f) << (7 * n);
+    if (!(p[n] & 0x80)) {
+      *v = value;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+static inline uint16_t series_getcount(const uint8_t *p, bool bigendian) {
+  return bigendian ? (uint16_t)(p[0] << 8 | p[1]) : (uint16_t)(p[1] << 8 | p[0]);
+}
+
+static inline void series_putcount(uint8_t *p, uint16_t v, bool bigendian) {
+  p[bigendian ? 0 : 1] = v >> 8;
+  p[bigendian ? 1 : 0] = v & 0xff;
+}
+
+// decodes delta series, calls sample(counts, n/2) for each sample,
+// returns number of samples or -1 if series is malformed
+template <class F>
+static int series_decode(const uint8_t *series, uint8_t size, bool bigendian,
+                         F sample) {
+  uint8_t const n = size ? series[0] & ~SERIES_DELTA_FLAG : 0;
+  uint16_t counts[SERIES_MAX_COUNTS];
+  uint8_t i = 1, used;
+  uint32_t v;
+  int samples = 1;
+
+  if (size < 1 + n || !n || (n & 1) || n / 2 > SERIES_MAX_COUNTS ||
+      !(series[0] & SERIES_DELTA_FLAG))
+    return -1;
+  for (uint8_t c = 0; c < n / 2; c++)
+    counts[c] = series_getcount(series + i + 2 * c, bigendian);
+  i += n;
+  sample(counts, n / 2);
+
+  while (i < size) {
+    for (uint8_t c = 0; c < n / 2; c++) {
+      if (!(used = varint_get(series + i, size - i, &v)))
+        return -1;
+      counts[c] += zigzag_decode(v);
+      i += used;
+    }
+    sample(counts, n / 2);
+    samples++;
+  }
+  return samples;
+}
+
+// appends sample of n bytes to delta series of size bytes, starts a new series
+// if size is 0. Returns new size of series, or 0 if it would exceed maxsize.
+static inline uint8_t series_append(uint8_t *series, uint8_t size,
+                                    uint8_t maxsize, const uint8_t *sample,
+                                    uint8_t n, bool bigendian) {
+  uint16_t last[SERIES_MAX_COUNTS];
+  uint8_t delta[SERIES_MAX_COUNTS * 3], len = 0;
+
+  if (!n || (n & 1) || n / 2 > SERIES_MAX_COUNTS)
+    return 0;
+
+  if (!size) {
+    if (1 + n > maxsize)
+      return 0;
+    series[0] = SERIES_DELTA_FLAG | n;
+    memcpy(series + 1, sample, n);
+    return 1 + n;
+  }
+
+  if (series[0] != (SERIES_DELTA_FLAG | n) ||
+      series_decode(series, size, bigendian,
+                    [&last](const uint16_t *counts, uint8_t k) {
+                      memcpy(last, counts, k * sizeof(uint16_t));
+                    }) < 0)
+    return 0;
+
+  for (uint8_t c = 0; c < n / 2; c++) {
+    int32_t const d = (int32_t)series_getcount(sample + 2 * c, bigendian) -
+                      (int32_t)last[c];
+    len += varint_put(delta + len, zigzag_encode(d));
+  }
+  if (size + len > maxsize)
+    return 0;
+  memcpy(series + size, delta, len);
+  return size + len;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef _SLIDINGWINDOW_H
+#define _SLIDINGWINDOW_H
+
+// Sliding window distinct counter.
+// Time is divided into buckets, each holding a HyperLogLog sketch of the
+// hashes seen during its period. Buckets are reused round robin, so memory is
+// constant. Unique count of the last n buckets is the estimate of the merged
+// sketches, which costs O(n) sketch merges instead of rebuilding a set.
+// The current bucket is partially filled, so a window of n periods spans the
+// current and n - 1 complete buckets when the current one is nearly full, and
+// n complete buckets right after it started. Both are estimated and weighted
+// by the elapsed part of the current period, so the window keeps its length
+// across bucket rollovers. This needs n + 1 buckets.
+
+#include "hyperloglog.h"
+
+template <uint8_t P, uint8_t BUCKETS> class SlidingWindow {
+
+public:
+  SlidingWindow() { clear(); }
+
+  // add hash seen in bucket period <epoch>, epochs must be monotonic
+  void add(uint32_t hash, uint32_t epoch) {
+    const uint8_t i = epoch % BUCKETS;
+    if (stamp[i] != epoch) {
+      bucket[i].clear(); // reuse oldest bucket for new period
+      stamp[i] = epoch;
+    }
+    bucket[i].add(hash);
+  }
+
+  // estimated unique hashes in the last <n> bucket periods, at <elapsed> of
+  // <period> into period <epoch>
+  uint32_t estimate(uint8_t n, uint32_t epoch, uint32_t elapsed,
+                    uint32_t period) {
+    if (n > BUCKETS - 1)
+      n = BUCKETS - 1;
+    if (!n)
+      return 0;
+    // current and n - 1 complete buckets
+    merged.clear();
+    for (uint8_t i = 0; i < BUCKETS; i++)
+      if ((stamp[i] != NOSTAMP) && (epoch - stamp[i] < n))
+        merged.merge(bucket[i]);
+    const uint64_t recent = merged.estimate();
+    // plus the n-th complete bucket
+    for (uint8_t i = 0; i < BUCKETS; i++)
+      if ((stamp[i] != NOSTAMP) && (epoch - stamp[i] == n))
+        merged.merge(bucket[i]);
+    const uint64_t full = merged.estimate();
+    if (elapsed > period)
+      elapsed = period;
+    return (full * (period - elapsed) + recent * elapsed) / period;
+  }
+
+  void clear(void) {
+    for (uint8_t i = 0; i < BUCKETS; i++) {
+      bucket[i].clear();
+      stamp[i] = NOSTAMP;
+    }
+  }
+
+private:
+  static constexpr uint32_t NOSTAMP = UINT32_MAX;
+
+  HyperLogLog<P> bucket[BUCKETS];
+  HyperLogLog<P> merged;
+  uint32_t stamp[BUCKETS];
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _SPIFRAME_H
+#define _SPIFRAME_H
+
+// Frames of the SPI slave interface.
+//
+// One SPI transaction carries as many queued messages as fit into the frame
+// and SPI_FRAME_RECORDS allows, each one as record
+//
+//   [crc16][port][size][payload of size bytes]
+//
+// crc16 is CRC-16/GENIBUS (crc16.h) over port, size and payload, stored LSB
+// first. A record header of 4 zero bytes ends the frame, the frame is padded
+// to a multiple of 4 bytes. The first record is laid out like the former one
+// message transactions, so one record per frame keeps former masters working.
+// With more records, commands of the master on RCMDPORT are sent as record of
+// the same layout.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "crc16.h"
+
+#define SPI_RECORD_HEADER 4
+
+// appends record to frame of maxsize bytes, used bytes are in use already.
+// Returns new number of used bytes, or 0 if record does not fit or is empty.
+static inline uint16_t spiframe_put(uint8_t *frame, uint16_t used,
+                                    uint16_t maxsize, uint8_t port,
+                                    const uint8_t *message, uint8_t size) {
+  if (!size || SPI_RECORD_HEADER + size > maxsize - used)
+    return 0;
+  uint8_t *record = frame + used;
+  record[2] = port;
+  record[3] = size;
+  memcpy(record + SPI_RECORD_HEADER, message, size);
+  uint16_t const crc = crc16_genibus(record + 2, size + 2);
+  record[0] = crc & 0xff;
+  record[1] = crc >> 8;
+  return used + SPI_RECORD_HEADER + size;
+}
+
+// ends frame after used bytes, returns transaction length in bytes,
+// a multiple of 4 and at least 8. maxsize must be a multiple of 4.
+static inline uint16_t spiframe_end(uint8_t *frame, uint16_t used,
+                                    uint16_t maxsize) {
+  uint16_t len = used + SPI_RECORD_HEADER;
+  if (len < 8)
+    len = 8;
+  len = (len + 3) & ~3;
+  if (len > maxsize)
+    len = maxsize;
+  memset(frame + used, 0, len - used);
+  return len;
+}
+
+// calls record(port, payload, size) for each record of a frame of len bytes,
+// returns number of records, or -1 if a record is truncated or its crc is
+// wrong. Records following a bad one are not read, since their offset is
+// unknown.
+template <class F>
+static int spiframe_parse(const uint8_t *frame, uint16_t len, F record) {
+  uint16_t i = 0;
+  int n = 0;
+
+  while (len - i >= SPI_RECORD_HEADER) {
+    uint8_t const size = frame[i + 3];
+    if (!size && !frame[i] && !frame[i + 1] && !frame[i + 2])
+      break; // end of frame
+    if (!size || SPI_RECORD_HEADER + size > len - i ||
+        crc16_genibus(frame + i + 2, size + 2) !=
+            (uint16_t)(frame[i] | frame[i + 1] << 8))
+      return -1;
+    record(frame[i + 2], frame + i + SPI_RECORD_HEADER, size);
+    i += SPI_RECORD_HEADER + size;
+    n++;
+  }
+  return n;
+}
+
+#endif
@@ -33,6 +33,7 @@ esp_err_t spi_init();
 void spi_deinit(void);
 void spi_enqueuedata(MessageBuffer_t *message);
 uint32_t spi_queuewaiting(void);
+bool spi_queueready(uint8_t port);
 void spi_queuereset(void);
 
 #endif // _SPISLAVE_H
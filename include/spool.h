@@ -0,0 +1,27 @@
+#ifndef _SPOOL_H
+#define _SPOOL_H
+
+#include "globals.h"
+#include "spoollog.h"
+#include <esp_partition.h>
+
+#ifndef SEND_SPOOL
+#define SEND_SPOOL 0
+#endif
+
+#define SPOOL_SEGMENT_SIZE 4096 // one flash sector per segment
+#define SPOOL_MAX_SEGMENTS 64
+#define SPOOL_DRAIN_MS 500 // poll cycle while no transport takes spooled data
+#define SPOOL_POOL_RESERVE 2 // send buffers the spool task leaves to live data
+
+// transports as targets of spooled records
+#define SPOOL_LORA 0x01
+#define SPOOL_SPI 0x02
+#define SPOOL_MQTT 0x04
+
+esp_err_t spool_init(void);
+uint8_t spool_enqueue(uint8_t port, const uint8_t *data, uint8_t size);
+uint32_t spool_waiting(void);
+void spool_reset(void);
+
+#endif
@@ -0,0 +1,353 @@
+#ifndef _SPOOLLOG_H
+#define _SPOOLLOG_H
+
+// Append only log of payloads on flash, for payloads a transport can not take
+// while it is backlogged. Each record is spooled for up to 8 targets, one bit
+// each, and is handed out to every target in order of appending.
+//
+// The flash area is a ring of up to S segments of one erase sector of SEG
+// bytes each. Segments are filled and erased in ring order, so every sector is
+// erased once per pass of the ring. When the ring is full, the oldest segment
+// is dropped with all records still pending in it. A segment starts with
+//
+//   [seq 4][magic 4]
+//
+// where seq counts up with each segment opened, followed by records
+//
+//   [crc16 2][state][len][targets][port][payload of len bytes]
+//
+// crc16 is CRC-16/GENIBUS over len, targets, port and payload, stored LSB
+// first. state starts as 0xff, a target clears its bit once the record was
+// handed to it. Flash bits are only cleared between erases, so records are
+// never rewritten. mount() rebuilds the read position of each target from
+// flash. A record failing its crc is a write torn by a reset, it closes its
+// segment and writing goes on in the next one. prepare() erases the next
+// segment ahead of time, so appends do not wait for an erase unless records
+// are still pending in the oldest segment of a full ring.
+//
+// F provides read(addr, dst, len), write(addr, src, len) and erase(addr) of
+// one sector, each returning true on success, and size() of the flash area.
+// Not thread safe, caller must serialize access.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "crc16.h"
+
+#define SPOOL_SEGMENT_HEADER 8
+#define SPOOL_RECORD_HEADER 6
+#define SPOOL_MAGIC 0x314c5053 // "SPL1"
+#define SPOOL_TARGETS 8
+
+template <class F, uint32_t SEG, uint32_t S> class SpoolLog {
+
+public:
+  SpoolLog(F &flash) : flash(flash), segments(0), dropped(0) { clear(); }
+
+  // reads log from flash, returns false if flash is too small or not readable
+  bool mount(void) {
+    uint32_t hdr[2], top = 0;
+
+    segments = flash.size() / SEG < S ? flash.size() / SEG : S;
+    clear();
+    if (segments < 2)
+      return false;
+    for (uint32_t i = 0; i < segments; i++) {
+      if (!flash.read(i * SEG, hdr, sizeof(hdr)))
+        return false;
+      seq[i] = (hdr[1] == SPOOL_MAGIC && hdr[0] != 0xffffffff) ? hdr[0] : 0;
+      if (seq[i] > seq[top])
+        top = i;
+    }
+    if (!seq[top])
+      return true; // empty
+
+    // live segments run backwards in ring order from the newest one, others
+    // are left over from before a reset or a torn open
+    head = top;
+    headseq = seq[top];
+    tailseq = headseq;
+    for (uint32_t k = 1; k < segments; k++) {
+      uint32_t const i = index(headseq - k);
+      if (!seq[i] || seq[i] != headseq - k)
+        break;
+      tailseq = headseq - k;
+    }
+    for (uint32_t i = 0; i < segments; i++)
+      if (seq[i] && (seq[i] < tailseq || seq[i] > headseq))
+        seq[i] = 0;
+
+    // count pending records, find first one of each target
+    for (uint32_t s = tailseq; s <= headseq; s++) {
+      uint16_t off = SPOOL_SEGMENT_HEADER;
+      int n;
+      while ((n = load(s, off)) > 0) {
+        uint8_t const todo = buf[TARGETS] & buf[STATE];
+        for (uint8_t t = 0; t < SPOOL_TARGETS; t++)
+          if ((todo & (1 << t)) && !pending[t]++)
+            cursor[t] = {s, off};
+        off += n;
+      }
+      if (s == headseq)
+        headoff = n < 0 ? off : SEG; // free space, or closed by torn record
+    }
+    for (uint8_t t = 0; t < SPOOL_TARGETS; t++)
+      if (!pending[t])
+        cursor[t] = end();
+    return true;
+  }
+
+  // appends record for targets, returns false if it could not be written
+  bool append(uint8_t targets, uint8_t port, const uint8_t *data,
+              uint8_t len) {
+    uint16_t const n = SPOOL_RECORD_HEADER + len;
+    uint8_t check[SPOOL_RECORD_HEADER + 255];
+
+    if (!targets || !len)
+      return false;
+
+    // a failed or torn write closes the segment, retry once in a fresh one
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+      if (headoff + n > SEG && !open())
+        return false;
+      buf[LEN] = len; // after open(), which may load records into buf
+      buf[TARGETS] = targets;
+      buf[PORT] = port;
+      memcpy(buf + SPOOL_RECORD_HEADER, data, len);
+      uint16_t const crc = crc16_genibus(buf + LEN, 3 + len);
+      buf[CRC] = crc & 0xff;
+      buf[CRC + 1] = crc >> 8;
+      buf[STATE] = 0xff;
+      uint32_t const addr = head * SEG + headoff;
+      if (flash.write(addr, buf, n) && flash.read(addr, check, n) &&
+          !memcmp(check, buf, n)) {
+        for (uint8_t t = 0; t < SPOOL_TARGETS; t++)
+          if ((targets & (1 << t)) && !pending[t]++)
+            cursor[t] = {headseq, headoff};
+        headoff += n;
+        return true;
+      }
+      headoff = SEG;
+    }
+    return false;
+  }
+
+  // next record pending for target, payload stays valid until next call
+  bool peek(uint8_t target, uint8_t &port, const uint8_t *&data,
+            uint8_t &len) {
+    uint8_t const t = bit(target);
+    Position &c = cursor[t];
+    int n;
+
+    while (pending[t] && c.seq <= headseq) {
+      if (c.seq == headseq && c.off >= headoff)
+        break;
+      n = load(c.seq, c.off);
+      if (n <= 0) {
+        c = {c.seq + 1, SPOOL_SEGMENT_HEADER}; // rest of segment is unused
+        continue;
+      }
+      if (buf[TARGETS] & buf[STATE] & target) {
+        port = buf[PORT];
+        len = buf[LEN];
+        data = buf + SPOOL_RECORD_HEADER;
+        peeked = c;
+        return true;
+      }
+      c.off += n;
+    }
+    pending[t] = 0; // counts were off, flash was changed by someone else
+    c = end();
+    return false;
+  }
+
+  // marks record of last peek() for target as handed out
+  void done(uint8_t target) {
+    uint8_t const t = bit(target);
+    Position &c = cursor[t];
+    uint32_t const addr = index(c.seq) * SEG + c.off;
+    uint8_t hdr[SPOOL_RECORD_HEADER];
+
+    if (!pending[t] || c.seq != peeked.seq || c.off != peeked.off ||
+        !flash.read(addr, hdr, sizeof(hdr)))
+      return;
+    hdr[STATE] &= ~target;
+    flash.write(addr + STATE, hdr + STATE, 1);
+    c.off += SPOOL_RECORD_HEADER + hdr[LEN];
+    if (!--pending[t])
+      c = end();
+  }
+
+  uint32_t waiting(uint8_t target) const { return pending[bit(target)]; }
+
+  // bit mask of targets with pending records
+  uint8_t backlog(void) const {
+    uint8_t mask = 0;
+    for (uint8_t t = 0; t < SPOOL_TARGETS; t++)
+      if (pending[t])
+        mask |= 1 << t;
+    return mask;
+  }
+
+  // erases next segment of ring ahead of time. If it is the oldest segment
+  // of a full ring, it is given up early, but only when all of its records
+  // were handed out. Returns true if a segment was erased.
+  bool prepare(void) {
+    uint32_t const next = (head + 1) % segments;
+    uint32_t const kill = 0;
+
+    if (segments < 2 || next == blank)
+      return false;
+    if (seq[next]) {
+      if (headseq == tailseq)
+        return false; // oldest segment is the one being written
+      for (uint8_t t = 0; t < SPOOL_TARGETS; t++)
+        if (pending[t] && cursor[t].seq <= tailseq)
+          return false;
+      drop(); // nothing pending, drops no records
+    }
+    // clear magic first, as in open()
+    if (!flash.write(next * SEG + 4, &kill, 4) || !flash.erase(next * SEG))
+      return false;
+    blank = next;
+    return true;
+  }
+
+  // erases all segments not blank, including those left over, since seq
+  // starts over
+  void reset(void) {
+    uint32_t hdr[2];
+    for (uint32_t i = 0; i < segments; i++)
+      if (!flash.read(i * SEG, hdr, sizeof(hdr)) || hdr[0] != 0xffffffff ||
+          hdr[1] != 0xffffffff)
+        flash.erase(i * SEG);
+    clear();
+  }
+
+  // number of segments in use and in total, records dropped by overflow since
+  // mount
+  uint32_t used(void) const { return headseq ? headseq - tailseq + 1 : 0; }
+  uint32_t capacity(void) const { return segments; }
+  uint32_t overflows(void) const { return dropped; }
+
+private:
+  enum { CRC = 0, STATE = 2, LEN = 3, TARGETS = 4, PORT = 5 };
+
+  struct Position {
+    uint32_t seq;
+    uint16_t off;
+  };
+
+  F &flash;
+  uint32_t segments;
+  uint32_t seq[S];                   // seq of live segments, 0 if unused
+  uint32_t head, headseq, tailseq;   // newest and oldest live segment
+  uint32_t blank;                    // segment erased by prepare()
+  uint16_t headoff;                  // write offset in newest segment
+  Position cursor[SPOOL_TARGETS];    // next record to check for each target
+  uint32_t pending[SPOOL_TARGETS];   // records not yet handed to each target
+  Position peeked;                   // record of last peek()
+  uint32_t dropped;
+  uint8_t buf[SPOOL_RECORD_HEADER + 255];
+
+  static uint8_t bit(uint8_t target) {
+    uint8_t t = 0;
+    while (target > 1) {
+      target >>= 1;
+      t++;
+    }
+    return t;
+  }
+
+  void clear(void) {
+    memset(seq, 0, sizeof(seq));
+    head = segments - 1;
+    headseq = 0;
+    tailseq = 1;
+    headoff = SEG; // closed, first append opens a segment
+    blank = segments; // none
+    for (uint8_t t = 0; t < SPOOL_TARGETS; t++) {
+      pending[t] = 0;
+      cursor[t] = end();
+    }
+    peeked = {0, 0};
+  }
+
+  Position end(void) const { return {headseq, headoff}; }
+
+  uint32_t index(uint32_t s) const {
+    return (head + segments - (headseq - s) % segments) % segments;
+  }
+
+  // reads valid record at off of segment s into buf, returns its length, -1
+  // at free space, 0 for no record
+  int load(uint32_t s, uint16_t off) {
+    uint32_t const addr = index(s) * SEG + off;
+    if (off + SPOOL_RECORD_HEADER > (int)SEG ||
+        !flash.read(addr, buf, SPOOL_RECORD_HEADER))
+      return 0;
+    uint16_t const n = SPOOL_RECORD_HEADER + buf[LEN];
+    uint8_t i = 0;
+    while (i < SPOOL_RECORD_HEADER && buf[i] == 0xff)
+      i++;
+    if (i == SPOOL_RECORD_HEADER)
+      return -1;
+    if (!buf[LEN] || off + n > SEG ||
+        !flash.read(addr + SPOOL_RECORD_HEADER, buf + SPOOL_RECORD_HEADER,
+                    buf[LEN]) ||
+        crc16_genibus(buf + LEN, 3 + buf[LEN]) !=
+            (buf[CRC] | buf[CRC + 1] << 8))
+      return 0;
+    return n;
+  }
+
+  // opens next segment of ring, drops the oldest one if ring is full
+  bool open(void) {
+    uint32_t const next = (head + 1) % segments;
+    uint32_t hdr[2] = {headseq + 1, SPOOL_MAGIC};
+    uint32_t const kill = 0;
+
+    if (used() == segments)
+      drop();
+    seq[next] = 0;
+    // clear magic first, a torn erase must not leave a valid looking header,
+    // seq is written before magic for the same reason
+    if (next != blank && (!flash.write(next * SEG + 4, &kill, 4) ||
+                          !flash.erase(next * SEG)))
+      return false;
+    blank = segments;
+    if (!flash.write(next * SEG, hdr, 4) ||
+        !flash.write(next * SEG + 4, hdr + 1, 4))
+      return false;
+    head = next;
+    headseq++;
+    headoff = SPOOL_SEGMENT_HEADER;
+    seq[head] = headseq;
+    for (uint8_t t = 0; t < SPOOL_TARGETS; t++)
+      if (!pending[t])
+        cursor[t] = end();
+    return true;
+  }
+
+  // gives up oldest segment and all records pending in it
+  void drop(void) {
+    uint16_t off = SPOOL_SEGMENT_HEADER;
+    int n;
+    while ((n = load(tailseq, off)) > 0) {
+      uint8_t const todo = buf[TARGETS] & buf[STATE];
+      for (uint8_t t = 0; t < SPOOL_TARGETS; t++)
+        if ((todo & (1 << t)) && pending[t])
+          pending[t]--;
+      if (todo)
+        dropped++;
+      off += n;
+    }
+    seq[index(tailseq)] = 0;
+    tailseq++;
+    for (uint8_t t = 0; t < SPOOL_TARGETS; t++)
+      if (cursor[t].seq < tailseq)
+        cursor[t] = {tailseq, SPOOL_SEGMENT_HEADER};
+  }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef _SPSCRING_H
+#define _SPSCRING_H
+
+// Lock-free single producer / single consumer ring buffer.
+// push() must only be called by one producer context, pop() and reset() only
+// by one consumer context. One slot is kept free to tell full from empty, so
+// the ring is allocated with N+1 slots to hold N items.
+
+#include <stdint.h>
+#include <atomic>
+
+template <class T, uint32_t N> class SpscRing {
+
+public:
+  SpscRing() : head(0), tail(0), drops(0) {}
+
+  // called by producer, returns false and counts a drop if ring is full
+  inline __attribute__((always_inline)) bool push(const T &item) {
+    const uint32_t h = head.load(std::memory_order_relaxed);
+    const uint32_t next = (h + 1 == N + 1) ? 0 : h + 1;
+    if (next == tail.load(std::memory_order_acquire)) {
+      drops++;
+      return false;
+    }
+    buf[h] = item;
+    head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // called by consumer, returns false if ring is empty
+  bool pop(T &item) {
+    const uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire))
+      return false;
+    item = buf[t];
+    tail.store((t + 1 == N + 1) ? 0 : t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // called by consumer, discards all waiting items
+  void reset(void) {
+    tail.store(head.load(std::memory_order_acquire),
+               std::memory_order_release);
+  }
+
+  bool empty(void) const {
+    return head.load(std::memory_order_acquire) ==
+           tail.load(std::memory_order_acquire);
+  }
+
+  uint32_t waiting(void) const {
+    const uint32_t h = head.load(std::memory_order_acquire);
+    const uint32_t t = tail.load(std::memory_order_acquire);
+    return (h >= t) ? h - t : h + N + 1 - t;
+  }
+
+  uint32_t dropped(void) const { return drops; }
+
+  static constexpr uint32_t capacity(void) { return N; }
+
+private:
+  T buf[N + 1];
+  std::atomic<uint32_t> head, tail;
+  volatile uint32_t drops;
+};
+
+#endif
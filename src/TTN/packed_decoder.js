@@ -41,6 +41,10 @@ function Decoder(bytes, port) {
         if (bytes.length === 20) {
             return decode(bytes, [uint16, uptime, uint8, uint32, uint8, uint32], ['voltage', 'uptime', 'cputemp', 'memory', 'reset0', 'restarts']);
         }
+        // MAC pipeline statistics
+        if (bytes.length === 34) {
+            return decode(bytes, [uint32, uint32, uint32, uint16, uint16, uint8, uint32, uint32, uint32, uint16, uint16, uint8], ['wifi_analyzed', 'wifi_dropped', 'wifi_filtered', 'wifi_p50', 'wifi_p99', 'wifi_peak', 'ble_analyzed', 'ble_dropped', 'ble_filtered', 'ble_p50', 'ble_p99', 'ble_peak']);
+        }
     }
 
     if (port === 3) {
@@ -94,6 +98,44 @@ function Decoder(bytes, port) {
         return decode(bytes, [uint16], ['ens']);
     }
 
+    if (port === 13) {
+        // sliding window counts
+        return decode(bytes, [uint16, uint16, uint16], ['window_short', 'window_mid', 'window_long']);
+    }
+
+    if (port === 14) {
+        // aggregated records, each framed as port + length + data
+        var i = 0;
+        decoded.records = [];
+        while (i + 2 <= bytes.length) {
+            var recordport = bytes[i++];
+            var recordlen = bytes[i++];
+            var record = Decoder(bytes.slice(i, i + recordlen), recordport);
+            record.port = recordport;
+            decoded.records.push(record);
+            i += recordlen;
+        }
+        return decoded;
+    }
+
+    if (port === 15) {
+        // fragment of a payload too large for datarate, reassemble by seq + index
+        decoded.fragment_port = bytes[0];
+        decoded.fragment_last = (bytes[1] >> 7) & 0x01;
+        decoded.fragment_seq = (bytes[1] >> 4) & 0x07;
+        decoded.fragment_index = bytes[1] & 0x0f;
+        decoded.fragment_data = bytes.slice(2);
+        return decoded;
+    }
+
+    if (port === 16) {
+        // queued counts merged into a time series, oldest sample first
+        decoded.series = seriesSamples(bytes).map(function (sample) {
+            return Decoder(sample, 1);
+        });
+        return decoded;
+    }
+
 }
 
 
@@ -101,9 +143,10 @@ function Decoder(bytes, port) {
 // https://github.com/thesolarnomad/lora-serialization/blob/master/src/decoder.js
 
 var bytesToInt = function (bytes) {
+    // no bit operators, they would truncate to signed 32 bit
     var i = 0;
-    for (var x = 0; x < bytes.length; x++) {
-        i |= (bytes[x] << (x * 8));
+    for (var x = bytes.length - 1; x >= 0; x--) {
+        i = i * 256 + bytes[x];
     }
     return i;
 };
@@ -292,6 +335,41 @@ var decode = function (bytes, mask, names) {
         }, {});
 };
 
+// splits a port 16 time series into samples, each in port 1 format
+var seriesSamples = function (bytes) {
+    var n = bytes[0] & 0x7f, i = 1, samples = [];
+    if (!(bytes[0] & 0x80)) {
+        // raw series: samples of n bytes each
+        for (; n > 0 && i + n <= bytes.length; i += n) {
+            samples.push(bytes.slice(i, i + n));
+        }
+        return samples;
+    }
+    // delta series: first sample as is, then one zig-zag varint per 16 bit count
+    if (n === 0 || (n & 1) || i + n > bytes.length) {
+        return samples;
+    }
+    var last = bytes.slice(i, i + n);
+    samples.push(last);
+    for (i += n; i < bytes.length;) {
+        var next = [];
+        for (var c = 0; c < n; c += 2) {
+            var v = 0, shift = 0, b;
+            do {
+                b = bytes[i++];
+                v += (b & 0x7f) * Math.pow(2, shift);
+                shift += 7;
+            } while ((b & 0x80) && i < bytes.length);
+            var value = ((last[c + 1] << 8) | last[c]) + ((v % 2) ? -(v + 1) / 2 : v / 2);
+            value = ((value % 65536) + 65536) % 65536;
+            next.push(value & 0xff, value >> 8);
+        }
+        samples.push(next);
+        last = next;
+    }
+    return samples;
+};
+
 if (typeof module === 'object' && typeof module.exports !== 'undefined') {
     module.exports = {
         uint8: uint8,
@@ -24,5 +24,12 @@ function Converter(decoded, port) {
 
   }
 
+  if (port === 14) {
+    // aggregated records are converted as if sent on their own port
+    converted.records = converted.records.map(function (record) {
+      return Converter(record, record.port);
+    });
+  }
+
   return converted;
 }
\ No newline at end of file
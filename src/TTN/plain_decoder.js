@@ -24,15 +24,31 @@ function Decoder(bytes, port) {
     }
   }
 
-  if (port === 2) {
+  // device status and MAC pipeline statistics, printed by tools/schemagen
+  if (port === 2 && bytes.length === 20) {
     var i = 0;
-    decoded.battery = ((bytes[i++] << 8) | bytes[i++]);
-    decoded.uptime = ((bytes[i++] << 56) | (bytes[i++] << 48) | (bytes[i++] << 40) | (bytes[i++] << 32) |
-      (bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]);
-    decoded.temp = bytes[i++];
-    decoded.memory = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]);
+    decoded.voltage = (bytes[i++] << 8) | bytes[i++];
+    decoded.uptime = bytes[i++] * 72057594037927936 + bytes[i++] * 281474976710656 + bytes[i++] * 1099511627776 + bytes[i++] * 4294967296 + bytes[i++] * 16777216 + bytes[i++] * 65536 + bytes[i++] * 256 + bytes[i++];
+    decoded.cputemp = bytes[i++];
+    decoded.memory = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]) >>> 0;
     decoded.reset0 = bytes[i++];
-    decoded.restarts = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]);
+    decoded.restarts = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]) >>> 0;
+  }
+
+  if (port === 2 && bytes.length === 34) {
+    var i = 0;
+    decoded.wifi_analyzed = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]) >>> 0;
+    decoded.wifi_dropped = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]) >>> 0;
+    decoded.wifi_filtered = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]) >>> 0;
+    decoded.wifi_p50 = (bytes[i++] << 8) | bytes[i++];
+    decoded.wifi_p99 = (bytes[i++] << 8) | bytes[i++];
+    decoded.wifi_peak = bytes[i++];
+    decoded.ble_analyzed = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]) >>> 0;
+    decoded.ble_dropped = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]) >>> 0;
+    decoded.ble_filtered = ((bytes[i++] << 24) | (bytes[i++] << 16) | (bytes[i++] << 8) | bytes[i++]) >>> 0;
+    decoded.ble_p50 = (bytes[i++] << 8) | bytes[i++];
+    decoded.ble_p99 = (bytes[i++] << 8) | bytes[i++];
+    decoded.ble_peak = bytes[i++];
   }
 
   if (port === 4) {
@@ -90,5 +106,80 @@ function Decoder(bytes, port) {
     }
   }
 
+  if (port === 13) {
+    // sliding window counts
+    var i = 0;
+    if (bytes.length >= 6) {
+      decoded.window_short = (bytes[i++] << 8) | bytes[i++];
+      decoded.window_mid = (bytes[i++] << 8) | bytes[i++];
+      decoded.window_long = (bytes[i++] << 8) | bytes[i++];
+    }
+  }
+
+  if (port === 14) {
+    // aggregated records, each framed as port + length + data
+    var i = 0;
+    decoded.records = [];
+    while (i + 2 <= bytes.length) {
+      var recordport = bytes[i++];
+      var recordlen = bytes[i++];
+      var record = Decoder(bytes.slice(i, i + recordlen), recordport);
+      record.port = recordport;
+      decoded.records.push(record);
+      i += recordlen;
+    }
+  }
+
+  if (port === 15) {
+    // fragment of a payload too large for datarate, reassemble by seq + index
+    decoded.fragment_port = bytes[0];
+    decoded.fragment_last = (bytes[1] >> 7) & 0x01;
+    decoded.fragment_seq = (bytes[1] >> 4) & 0x07;
+    decoded.fragment_index = bytes[1] & 0x0f;
+    decoded.fragment_data = bytes.slice(2);
+  }
+
+  if (port === 16) {
+    // queued counts merged into a time series, oldest sample first
+    decoded.series = seriesSamples(bytes).map(function (sample) {
+      return Decoder(sample, 1);
+    });
+  }
+
   return decoded;
 }
+
+// splits a port 16 time series into samples, each in port 1 format
+var seriesSamples = function (bytes) {
+  var n = bytes[0] & 0x7f, i = 1, samples = [];
+  if (!(bytes[0] & 0x80)) {
+    // raw series: samples of n bytes each
+    for (; n > 0 && i + n <= bytes.length; i += n) {
+      samples.push(bytes.slice(i, i + n));
+    }
+    return samples;
+  }
+  // delta series: first sample as is, then one zig-zag varint per 16 bit count
+  if (n === 0 || (n & 1) || i + n > bytes.length) {
+    return samples;
+  }
+  var last = bytes.slice(i, i + n);
+  samples.push(last);
+  for (i += n; i < bytes.length;) {
+    var next = [];
+    for (var c = 0; c < n; c += 2) {
+      var v = 0, shift = 0, b;
+      do {
+        b = bytes[i++];
+        v += (b & 0x7f) * Math.pow(2, shift);
+        shift += 7;
+      } while ((b & 0x80) && i < bytes.length);
+      var value = ((last[c] << 8) | last[c + 1]) + ((v % 2) ? -(v + 1) / 2 : v / 2);
+      value = ((value % 65536) + 65536) % 65536;
+      next.push(value >> 8, value & 0xff);
+    }
+    samples.push(next);
+    last = next;
+  }
+  return samples;
+};
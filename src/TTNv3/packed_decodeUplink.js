@@ -49,6 +49,10 @@ function decodeUplink(input) {
         if (input.bytes.length === 20) {
             data = decode(input.bytes, [uint16, uptime, uint8, uint32, uint8, uint32], ['voltage', 'uptime', 'cputemp', 'memory', 'reset0', 'restarts']);
         }
+        // MAC pipeline statistics
+        if (input.bytes.length === 34) {
+            data = decode(input.bytes, [uint32, uint32, uint32, uint16, uint16, uint8, uint32, uint32, uint32, uint16, uint16, uint8], ['wifi_analyzed', 'wifi_dropped', 'wifi_filtered', 'wifi_p50', 'wifi_p99', 'wifi_peak', 'ble_analyzed', 'ble_dropped', 'ble_filtered', 'ble_p50', 'ble_p99', 'ble_peak']);
+        }
     }
 
     if (input.fPort === 3) {
@@ -100,6 +104,44 @@ function decodeUplink(input) {
         // ENS count      
         data = decode(input.bytes, [uint16], ['ens']);
     }
+
+    if (input.fPort === 13) {
+        // sliding window counts
+        data = decode(input.bytes, [uint16, uint16, uint16], ['window_short', 'window_mid', 'window_long']);
+    }
+
+    if (input.fPort === 14) {
+        // aggregated records, each framed as port + length + data
+        var i = 0;
+        data.records = [];
+        while (i + 2 <= input.bytes.length) {
+            var recordport = input.bytes[i++];
+            var recordlen = input.bytes[i++];
+            var record = decodeUplink({ fPort: recordport, bytes: input.bytes.slice(i, i + recordlen) }).data;
+            delete record.bytes;
+            data.records.push(record);
+            i += recordlen;
+        }
+    }
+
+    if (input.fPort === 15) {
+        // fragment of a payload too large for datarate, reassemble by seq + index
+        data.fragment_port = input.bytes[0];
+        data.fragment_last = (input.bytes[1] >> 7) & 0x01;
+        data.fragment_seq = (input.bytes[1] >> 4) & 0x07;
+        data.fragment_index = input.bytes[1] & 0x0f;
+        data.fragment_data = input.bytes.slice(2);
+    }
+
+    if (input.fPort === 16) {
+        // queued counts merged into a time series, oldest sample first
+        data.series = seriesSamples(input.bytes).map(function (bytes) {
+            var sample = decodeUplink({ fPort: 1, bytes: bytes }).data;
+            delete sample.bytes;
+            delete sample.port;
+            return sample;
+        });
+    }
     
     data.bytes = input.bytes; // comment out if you do not want to include the original payload
     data.port = input.fPort; // comment out if you do not want to inlude the port
@@ -116,9 +158,10 @@ function decodeUplink(input) {
 // https://github.com/thesolarnomad/lora-serialization/blob/master/src/decoder.js
 
 var bytesToInt = function (bytes) {
+    // no bit operators, they would truncate to signed 32 bit
     var i = 0;
-    for (var x = 0; x < bytes.length; x++) {
-        i |= (bytes[x] << (x * 8));
+    for (var x = bytes.length - 1; x >= 0; x--) {
+        i = i * 256 + bytes[x];
     }
     return i;
 };
@@ -307,6 +350,41 @@ var decode = function (bytes, mask, names) {
         }, {});
 };
 
+// splits a port 16 time series into samples, each in port 1 format
+var seriesSamples = function (bytes) {
+    var n = bytes[0] & 0x7f, i = 1, samples = [];
+    if (!(bytes[0] & 0x80)) {
+        // raw series: samples of n bytes each
+        for (; n > 0 && i + n <= bytes.length; i += n) {
+            samples.push(bytes.slice(i, i + n));
+        }
+        return samples;
+    }
+    // delta series: first sample as is, then one zig-zag varint per 16 bit count
+    if (n === 0 || (n & 1) || i + n > bytes.length) {
+        return samples;
+    }
+    var last = bytes.slice(i, i + n);
+    samples.push(last);
+    for (i += n; i < bytes.length;) {
+        var next = [];
+        for (var c = 0; c < n; c += 2) {
+            var v = 0, shift = 0, b;
+            do {
+                b = bytes[i++];
+                v += (b & 0x7f) * Math.pow(2, shift);
+                shift += 7;
+            } while ((b & 0x80) && i < bytes.length);
+            var value = ((last[c + 1] << 8) | last[c]) + ((v % 2) ? -(v + 1) / 2 : v / 2);
+            value = ((value % 65536) + 65536) % 65536;
+            next.push(value & 0xff, value >> 8);
+        }
+        samples.push(next);
+        last = next;
+    }
+    return samples;
+};
+
 if (typeof module === 'object' && typeof module.exports !== 'undefined') {
     module.exports = {
         uint8: uint8,
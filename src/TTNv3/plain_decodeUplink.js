@@ -32,14 +32,31 @@ function decodeUplink(input) {
         } 
     }
 
-    if (input.fPort === 2) {
+    // device status and MAC pipeline statistics, printed by tools/schemagen
+    if (input.fPort === 2 && input.bytes.length === 20) {
         var i = 0;
-        data.voltage = ((input.bytes[i++] << 8) | input.bytes[i++]);
-        data.uptime = ((input.bytes[i++] << 56) | (input.bytes[i++] << 48) | (input.bytes[i++] << 40) | (input.bytes[i++] << 32) | (input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]);
+        data.voltage = (input.bytes[i++] << 8) | input.bytes[i++];
+        data.uptime = input.bytes[i++] * 72057594037927936 + input.bytes[i++] * 281474976710656 + input.bytes[i++] * 1099511627776 + input.bytes[i++] * 4294967296 + input.bytes[i++] * 16777216 + input.bytes[i++] * 65536 + input.bytes[i++] * 256 + input.bytes[i++];
         data.cputemp = input.bytes[i++];
-        data.memory = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]);
+        data.memory = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]) >>> 0;
         data.reset0 = input.bytes[i++];
-        data.restarts = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]);
+        data.restarts = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]) >>> 0;
+    }
+
+    if (input.fPort === 2 && input.bytes.length === 34) {
+        var i = 0;
+        data.wifi_analyzed = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]) >>> 0;
+        data.wifi_dropped = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]) >>> 0;
+        data.wifi_filtered = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]) >>> 0;
+        data.wifi_p50 = (input.bytes[i++] << 8) | input.bytes[i++];
+        data.wifi_p99 = (input.bytes[i++] << 8) | input.bytes[i++];
+        data.wifi_peak = input.bytes[i++];
+        data.ble_analyzed = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]) >>> 0;
+        data.ble_dropped = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]) >>> 0;
+        data.ble_filtered = ((input.bytes[i++] << 24) | (input.bytes[i++] << 16) | (input.bytes[i++] << 8) | input.bytes[i++]) >>> 0;
+        data.ble_p50 = (input.bytes[i++] << 8) | input.bytes[i++];
+        data.ble_p99 = (input.bytes[i++] << 8) | input.bytes[i++];
+        data.ble_peak = input.bytes[i++];
     }
 
     if (input.fPort === 4) {
@@ -97,7 +114,51 @@ function decodeUplink(input) {
         }
     }
 
-    if (data.hdop) {
+    if (input.fPort === 13) {
+        // sliding window counts
+        var i = 0;
+        if (input.bytes.length >= 6) {
+            data.window_short = (input.bytes[i++] << 8) | input.bytes[i++];
+            data.window_mid = (input.bytes[i++] << 8) | input.bytes[i++];
+            data.window_long = (input.bytes[i++] << 8) | input.bytes[i++];
+        }
+    }
+
+    if (input.fPort === 14) {
+        // aggregated records, each framed as port + length + data
+        var i = 0;
+        data.records = [];
+        while (i + 2 <= input.bytes.length) {
+            var recordport = input.bytes[i++];
+            var recordlen = input.bytes[i++];
+            var record = decodeUplink({ fPort: recordport, bytes: input.bytes.slice(i, i + recordlen) }).data;
+            delete record.bytes;
+            data.records.push(record);
+            i += recordlen;
+        }
+    }
+
+    if (input.fPort === 15) {
+        // fragment of a payload too large for datarate, reassemble by seq + index
+        data.fragment_port = input.bytes[0];
+        data.fragment_last = (input.bytes[1] >> 7) & 0x01;
+        data.fragment_seq = (input.bytes[1] >> 4) & 0x07;
+        data.fragment_index = input.bytes[1] & 0x0f;
+        data.fragment_data = input.bytes.slice(2);
+    }
+
+    if (input.fPort === 16) {
+        // queued counts merged into a time series, oldest sample first
+        data.series = seriesSamples(input.bytes).map(function (bytes) {
+            var sample = decodeUplink({ fPort: 1, bytes: bytes }).data;
+            delete sample.bytes;
+            delete sample.port;
+            return sample;
+        });
+    }
+
+    // aggregated records were scaled already when decoding them
+    if (data.hdop && input.fPort !== 14) {
         data.hdop /= 100;
         data.latitude /= 1000000;
         data.longitude /= 1000000;
@@ -111,4 +172,39 @@ function decodeUplink(input) {
         warnings: [],
         errors: []
     };
-}
\ No newline at end of file
+}
+
+// splits a port 16 time series into samples, each in port 1 format
+var seriesSamples = function (bytes) {
+    var n = bytes[0] & 0x7f, i = 1, samples = [];
+    if (!(bytes[0] & 0x80)) {
+        // raw series: samples of n bytes each
+        for (; n > 0 && i + n <= bytes.length; i += n) {
+            samples.push(bytes.slice(i, i + n));
+        }
+        return samples;
+    }
+    // delta series: first sample as is, then one zig-zag varint per 16 bit count
+    if (n === 0 || (n & 1) || i + n > bytes.length) {
+        return samples;
+    }
+    var last = bytes.slice(i, i + n);
+    samples.push(last);
+    for (i += n; i < bytes.length;) {
+        var next = [];
+        for (var c = 0; c < n; c += 2) {
+            var v = 0, shift = 0, b;
+            do {
+                b = bytes[i++];
+                v += (b & 0x7f) * Math.pow(2, shift);
+                shift += 7;
+            } while ((b & 0x80) && i < bytes.length);
+            var value = ((last[c] << 8) | last[c + 1]) + ((v % 2) ? -(v + 1) / 2 : v / 2);
+            value = ((value % 65536) + 65536) % 65536;
+            next.push(value >> 8, value & 0xff);
+        }
+        samples.push(next);
+        last = next;
+    }
+    return samples;
+};
\ No newline at end of file
@@ -23,7 +23,7 @@ static const char TAG[] = __FILE__;
 #define FORGET_AFTER_MINUTES 2
 
 // array of timestamps for seen notifiers: hash -> timestamp[ms]
-static std::map<uint16_t, unsigned long> cwaSeenNotifiers;
+static std::map<hashedmac_t, unsigned long> cwaSeenNotifiers;
 
 // Remove notifiers last seen over FORGET_AFTER_MINUTES ago.
 void cwa_clear() {
@@ -47,7 +47,7 @@ bool cwa_init(void) {
   return true;
 }
 
-void cwa_mac_add(uint16_t hashedmac) {
+void cwa_mac_add(hashedmac_t hashedmac) {
   cwaSeenNotifiers[hashedmac] = millis(); // hash last seen at ....
 }
 
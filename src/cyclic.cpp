@@ -32,6 +32,16 @@ void doHousekeeping() {
   ESP_LOGD(TAG, "MACprocessor %d bytes left | Taskstate = %d",
            uxTaskGetStackHighWaterMark(macProcessTask),
            eTaskGetState(macProcessTask));
+  ESP_LOGD(TAG, "MAC rings lost %d Wifi / %d BLE packets due to dense traffic",
+           mac_drops(MAC_SNIFF_WIFI), mac_drops(MAC_SNIFF_BLE));
+  ESP_LOGD(TAG, "MAC duplicate filter hits/misses: Wifi %d/%d, BLE %d/%d",
+           mac_dedup_hits(MAC_SNIFF_WIFI), mac_dedup_misses(MAC_SNIFF_WIFI),
+           mac_dedup_hits(MAC_SNIFF_BLE), mac_dedup_misses(MAC_SNIFF_BLE));
+  if (macs.overflow())
+    ESP_LOGW(TAG, "MAC container full, %d inserts of new MACs rejected",
+             macs.overflow());
+  ESP_LOGD(TAG, "Send buffers %d/%d in use, %d payloads dropped",
+           sendpool.in_use(), sendpool.capacity(), sendpool.exhausted());
   ESP_LOGD(TAG, "Rcommand interpreter %d bytes left | Taskstate = %d",
            uxTaskGetStackHighWaterMark(rcmdTask), eTaskGetState(rcmdTask));
 #if (HAS_LORA)
@@ -137,9 +147,7 @@ void reset_counters() {
 
 #if ((WIFICOUNTER) || (BLECOUNTER))
 #if !(LIBPAX)   
-  macs.clear(); // clear all macs container
-  macs_wifi = 0;
-  macs_ble = 0;
+  mac_reset(); // clear macs container, counters and estimators
   renew_salt(); // get new salt 
 #endif
 #ifdef HAS_DISPLAY
@@ -19,7 +19,11 @@ RTC_DATA_ATTR lmic_t RTC_LMIC;
 #endif
 #endif
 
-static QueueHandle_t LoraSendQueue;
+static const uint32_t LoraPrioSize[LORA_PRIO_CLASSES] = {
+    SEND_PRIO_HIGH_SIZE, SEND_PRIO_MID_SIZE, SEND_PRIO_LOW_SIZE};
+static LoraQueue_t LoraSendQueue(LoraPrioSize);
+static SemaphoreHandle_t LoraQueueLock, LoraQueueSignal;
+static MessageBuffer_t *LoraSending = NULL; // message lora_send() works on
 TaskHandle_t lmicTask = NULL, lorasendTask = NULL;
 
 class MyHalConfig_t : public Arduino_LMIC::HalConfiguration_t {
@@ -179,11 +183,143 @@ void showLoraKeys(void) {
 
 #endif // VERBOSE
 
+// max. application payload at current datarate, frame length is taken from
+// LMIC's bandplan, which knows the region and dwell time limits
+uint8_t lora_maxpayload(void) {
+  uint8_t const frame = LMICbandplan_maxFrameLen(LMIC.datarate);
+  // MAC commands waiting to be piggybacked reduce space for our payload
+  uint8_t const overhead = LORA_FRAME_OVERHEAD + LMIC.pendMacLen;
+  uint8_t const n = (frame > overhead) ? frame - overhead : 0;
+  return min(n, (uint8_t)sizeof(LMIC.pendTxData));
+}
+
+// state of a queued message which is sent in several parts
+typedef struct {
+  MessageBuffer_t *msg;       // message being sent, we hold a reference to it
+  uint8_t offset;             // bytes of message sent so far
+  uint8_t index;              // number of fragments sent so far
+  uint8_t seq;                // sequence number of fragmented messages
+  bool fragmenting;           // rest of message goes out in fragments
+} loraSplit_t;
+
+// puts next part of msg fitting into limit bytes into piece, sets consumed to
+// message bytes covered by piece, returns false if nothing fits into limit
+static bool lora_nextpiece(loraSplit_t *split, const MessageBuffer_t *msg,
+                           uint8_t limit, uint8_t *port, uint8_t *piece,
+                           uint8_t *size, uint8_t *consumed) {
+  uint8_t const left = msg->MessageSize - split->offset;
+  const uint8_t *rest = msg->Message + split->offset;
+  uint8_t len = 0;
+
+  // message fits as a whole
+  if (!split->offset && msg->MessageSize <= limit) {
+    *port = msg->MessagePort;
+    memcpy(piece, msg->Message, msg->MessageSize);
+    *size = *consumed = msg->MessageSize;
+    return true;
+  }
+
+#if (PAYLOAD_AGGREGATE)
+  // aggregated records: send as many whole records as fit
+  if (!split->fragmenting && msg->MessagePort == AGGREGATEPORT) {
+    uint8_t records = 0;
+    while (len + AGGREGATE_HEADER_SIZE <= left &&
+           len + AGGREGATE_HEADER_SIZE + rest[len + 1] <= left &&
+           len + AGGREGATE_HEADER_SIZE + rest[len + 1] <= limit) {
+      len += AGGREGATE_HEADER_SIZE + rest[len + 1];
+      records++;
+    }
+    if (records == 1) { // single record goes out unframed on its own port
+      *port = rest[0];
+      memcpy(piece, rest + AGGREGATE_HEADER_SIZE, len - AGGREGATE_HEADER_SIZE);
+      *size = len - AGGREGATE_HEADER_SIZE;
+      *consumed = len;
+      return true;
+    }
+    if (records) {
+      *port = AGGREGATEPORT;
+      memcpy(piece, rest, len);
+      *size = *consumed = len;
+      return true;
+    }
+  }
+#endif
+
+  // fragments with header [port][last | seq | index]
+  if (limit <= FRAGMENT_HEADER_SIZE || split->index > FRAGMENT_MAX_INDEX)
+    return false;
+  len = min(left, (uint8_t)(limit - FRAGMENT_HEADER_SIZE));
+  *port = FRAGMENTPORT;
+  piece[0] = msg->MessagePort;
+  piece[1] = ((len == left) ? 0x80 : 0x00) | ((split->seq & 0x07) << 4) |
+             split->index;
+  memcpy(piece + FRAGMENT_HEADER_SIZE, rest, len);
+  split->fragmenting = true;
+  *size = len + FRAGMENT_HEADER_SIZE;
+  *consumed = len;
+  return true;
+}
+
+// deletes message from queue, after it was sent completely or given up
+static void lora_dequeue(loraSplit_t *split, MessageBuffer_t *msg) {
+  bool queued;
+  if (split->fragmenting)
+    split->seq++;
+  split->msg = NULL;
+  xSemaphoreTake(LoraQueueLock, portMAX_DELAY);
+  queued = LoraSendQueue.remove(msg);
+  LoraSending = NULL;
+  xSemaphoreGive(LoraQueueLock);
+  // LMIC has its own copy of the data now, give back queue's and our reference
+  if (queued)
+    sendpool.release(msg);
+  sendpool.release(msg);
+}
+
+// waits for most urgent message and takes a reference, to keep it alive while
+// we are sending it. A message partly sent already is finished first.
+static void lora_peek(MessageBuffer_t **msg, MessageBuffer_t *current) {
+  bool found;
+  while (1) {
+    xSemaphoreTake(LoraQueueLock, portMAX_DELAY);
+    if (current && LoraSendQueue.contains(current)) {
+      *msg = current;
+      found = true;
+    } else
+      found = LoraSendQueue.peek(*msg);
+    if (found) {
+      sendpool.retain(*msg);
+      LoraSending = *msg;
+    }
+    xSemaphoreGive(LoraQueueLock);
+    if (found)
+      return;
+    xSemaphoreTake(LoraQueueSignal, portMAX_DELAY);
+  }
+}
+
+// priority class of messages for a port
+static uint8_t lora_prio(uint8_t port) {
+  static const uint8_t high[] = {SEND_PRIO_HIGH_PORTS};
+  static const uint8_t mid[] = {SEND_PRIO_MID_PORTS};
+  for (uint8_t p : high)
+    if (p == port)
+      return LORA_PRIO_HIGH;
+  for (uint8_t p : mid)
+    if (p == port)
+      return LORA_PRIO_MID;
+  return LORA_PRIO_LOW;
+}
+
 // LMIC send task
 void lora_send(void *pvParameters) {
   _ASSERT((uint32_t)pvParameters == 1); // FreeRTOS check
 
-  MessageBuffer_t SendBuffer;
+  MessageBuffer_t *SendBuffer;
+  loraSplit_t split = {NULL, 0, 0, 0, false};
+  uint8_t piece[PAYLOAD_BUFFER_SIZE + FRAGMENT_HEADER_SIZE];
+  uint8_t port, size, consumed, limit, shrink = 0;
+  u1_t shrinkdr = 0; // datarate at which LMIC rejected shrink bytes
 
   while (1) {
 
@@ -192,28 +328,62 @@ void lora_send(void *pvParameters) {
       vTaskDelay(pdMS_TO_TICKS(500));
     }
 
-    // fetch next or wait for payload to send from queue
+    // fetch most urgent or wait for payload to send from queue
     // do not delete item from queue until it is transmitted
-    if (xQueuePeek(LoraSendQueue, &SendBuffer, portMAX_DELAY) != pdTRUE) {
-      ESP_LOGE(TAG, "Premature return from xQueueReceive() with no data!");
+    lora_peek(&SendBuffer, split.offset ? split.msg : NULL);
+
+    if (split.msg == SendBuffer)
+      sendpool.release(SendBuffer); // we already hold a reference
+    else {
+      // start over with new message, previous was dropped or preempted
+      if (split.msg)
+        sendpool.release(split.msg);
+      if (split.fragmenting)
+        split.seq++;
+      split.msg = SendBuffer;
+      split.offset = split.index = 0;
+      split.fragmenting = false;
+      shrink = 0;
+    }
+
+    // take as much of the message as current datarate allows, and half of
+    // what LMIC rejected at this datarate
+    limit = lora_maxpayload();
+    if (shrink && LMIC.datarate != shrinkdr)
+      shrink = 0;
+    if (shrink && shrink <= limit)
+      limit = shrink / 2;
+    if (!lora_nextpiece(&split, SendBuffer, limit, &port, piece, &size,
+                        &consumed)) {
+      if (limit > FRAGMENT_HEADER_SIZE) {
+        // too many fragments, message cannot be sent
+        ESP_LOGE(TAG, "Message too large to send, message not sent and "
+                      "deleted");
+        lora_dequeue(&split, SendBuffer);
+      } else
+        vTaskDelay(pdMS_TO_TICKS(500 + random(400))); // wait for better DR
       continue;
     }
 
     // attempt to transmit payload
-    switch (LMIC_setTxData2_strict(SendBuffer.MessagePort, SendBuffer.Message,
-                                   SendBuffer.MessageSize,
+    switch (LMIC_setTxData2_strict(port, piece, size,
                                    (cfg.countermode & 0x02))) {
 
     case LMIC_ERROR_SUCCESS:
 #if (TIME_SYNC_LORASERVER)
       // if last packet sent was a timesync request, store TX timestamp
-      if (SendBuffer.MessagePort == TIMEPORT)
+      if (port == TIMEPORT)
         // store LMIC time when we started transmit of timesync request
         timesync_store(osticks2ms(os_getTime()), timesync_tx);
 #endif
-      ESP_LOGI(TAG, "%d byte(s) sent to LORA", SendBuffer.MessageSize);
-      // delete sent item from queue
-      xQueueReceive(LoraSendQueue, &SendBuffer, (TickType_t)0);
+      ESP_LOGI(TAG, "%d byte(s) sent to LORA", size);
+      shrink = 0;
+      split.offset += consumed;
+      if (split.fragmenting)
+        split.index++;
+      // delete sent item from queue, if no parts of it are left
+      if (split.offset >= SendBuffer->MessageSize)
+        lora_dequeue(&split, SendBuffer);
       break;
     case LMIC_ERROR_TX_BUSY:   // LMIC already has a tx message pending
     case LMIC_ERROR_TX_FAILED: // message was not sent
@@ -222,11 +392,23 @@ void lora_send(void *pvParameters) {
     case LMIC_ERROR_TX_TOO_LARGE:    // message size exceeds LMIC buffer size
     case LMIC_ERROR_TX_NOT_FEASIBLE: // message too large for current
                                      // datarate
-      ESP_LOGI(TAG, "Message too large to send, message not sent and deleted");
-      // we need some kind of error handling here -> to be done
+      // LMIC limit is below ours, retry with parts of half the size
+      if (size <= 2 * (FRAGMENT_HEADER_SIZE + 1)) {
+        ESP_LOGE(TAG, "LMIC rejects message for port %d, message not sent "
+                      "and deleted",
+                 SendBuffer->MessagePort);
+        lora_dequeue(&split, SendBuffer);
+        shrink = 0;
+        break;
+      }
+      ESP_LOGI(TAG, "%d byte(s) too large for current datarate, splitting",
+               size);
+      shrink = size;
+      shrinkdr = LMIC.datarate;
       break;
     default: // other LMIC return code
       ESP_LOGE(TAG, "LMIC error, message not sent and deleted");
+      lora_dequeue(&split, SendBuffer);
 
     }         // switch
     delay(2); // yield to CPU
@@ -235,13 +417,14 @@ void lora_send(void *pvParameters) {
 
 esp_err_t lmic_init(void) {
   _ASSERT(SEND_QUEUE_SIZE > 0);
-  LoraSendQueue = xQueueCreate(SEND_QUEUE_SIZE, sizeof(MessageBuffer_t));
-  if (LoraSendQueue == 0) {
+  LoraQueueLock = xSemaphoreCreateMutex();
+  LoraQueueSignal = xSemaphoreCreateBinary();
+  if (LoraQueueLock == NULL || LoraQueueSignal == NULL) {
     ESP_LOGE(TAG, "Could not create LORA send queue. Aborting.");
     return ESP_FAIL;
   }
   ESP_LOGI(TAG, "LORA send queue created, size %d Bytes",
-           SEND_QUEUE_SIZE * sizeof(MessageBuffer_t));
+           sizeof(LoraSendQueue));
 
   // setup LMIC stack
   os_init_ex(&myPinmap); // initialize lmic run-time environment
@@ -312,23 +495,155 @@ esp_err_t lmic_init(void) {
   return ESP_OK;
 }
 
+#if (SEND_COALESCE)
+
+// first sample of a new series
+static uint8_t lora_seriesstart(uint8_t *series, const uint8_t *sample,
+                                uint8_t len) {
+#if (SERIES_DELTA)
+  return series_append(series, 0, PAYLOAD_BUFFER_SIZE, sample, len,
+                       PAYLOAD_ENCODER == 1);
+#else
+  if (1 + len > PAYLOAD_BUFFER_SIZE)
+    return 0;
+  series[0] = len;
+  memcpy(series + 1, sample, len);
+  return 1 + len;
+#endif
+}
+
+// appends sample to series, returns 0 if it does not fit
+static uint8_t lora_seriesadd(uint8_t *series, uint8_t size,
+                              const uint8_t *sample, uint8_t len) {
+  if (!size)
+    return 0;
+#if (SERIES_DELTA)
+  return series_append(series, size, PAYLOAD_BUFFER_SIZE, sample, len,
+                       PAYLOAD_ENCODER == 1);
+#else
+  if (size + len > PAYLOAD_BUFFER_SIZE)
+    return 0;
+  memcpy(series + size, sample, len);
+  return size + len;
+#endif
+}
+
+// true for ports where a new message supersedes a queued one
+static bool lora_latestwins(uint8_t port) {
+  static const uint8_t latest[] = {SEND_LATEST_PORTS};
+  if (port == COUNTERPORT)
+    return cfg.countermode == 1; // cumulative counts
+  for (uint8_t p : latest)
+    if (p == port)
+      return true;
+  return false;
+}
+
+// merges message into a queued one not being sent yet, returns false if there
+// is none. Caller must hold queue lock.
+static bool lora_coalesce(MessageBuffer_t *message) {
+  uint8_t const port = message->MessagePort, len = message->MessageSize;
+  MessageBuffer_t *queued, *merged;
+  uint8_t size;
+
+  // latest wins -> new message takes place of queued one
+  if (lora_latestwins(port)) {
+    if (!LoraSendQueue.find(
+            [port](MessageBuffer_t *m) {
+              return m != LoraSending && m->MessagePort == port;
+            },
+            queued))
+      return false;
+    LoraSendQueue.replace(queued, message);
+    sendpool.release(queued);
+    return true;
+  }
+
+  // cyclic counts -> append to queued counts as time series
+  if (port != COUNTERPORT || !len)
+    return false;
+  if (!LoraSendQueue.find(
+          [len](MessageBuffer_t *m) {
+            return m != LoraSending &&
+                   ((m->MessagePort == COUNTERPORT && m->MessageSize == len) ||
+                    (m->MessagePort == SERIESPORT &&
+                     m->Message[0] == SERIES_HEADER(len)));
+          },
+          queued))
+    return false;
+  merged = sendpool.alloc(1);
+  if (merged == NULL)
+    return false;
+
+  // series format see seriescodec.h
+  merged->MessagePort = SERIESPORT;
+  if (queued->MessagePort == SERIESPORT) {
+    memcpy(merged->Message, queued->Message, queued->MessageSize);
+    size = queued->MessageSize;
+  } else
+    size = lora_seriesstart(merged->Message, queued->Message, len);
+  size = lora_seriesadd(merged->Message, size, message->Message, len);
+  if (!size) { // does not fit
+    sendpool.release(merged);
+    return false;
+  }
+  merged->MessageSize = size;
+
+  LoraSendQueue.replace(queued, merged);
+  sendpool.release(queued);
+  sendpool.release(message);
+  return true;
+}
+
+#endif // SEND_COALESCE
+
 void lora_enqueuedata(MessageBuffer_t *message) {
-  // enqueue message in LORA send queue
-  if (xQueueSendToBack(LoraSendQueue, (void *)message, (TickType_t)0) !=
-      pdTRUE) {
+  MessageBuffer_t *dropped;
+  uint8_t const port = message->MessagePort;
+  bool full;
+  // enqueue message in LORA send queue, by priority of its port
+  xSemaphoreTake(LoraQueueLock, portMAX_DELAY);
+#if (SEND_COALESCE)
+  if (lora_coalesce(message)) {
+    xSemaphoreGive(LoraQueueLock);
+    ESP_LOGD(TAG, "Message for port %d merged into queued one", port);
+    return;
+  }
+#endif
+  full = LoraSendQueue.push(message, lora_prio(port), dropped);
+  xSemaphoreGive(LoraQueueLock);
+  xSemaphoreGive(LoraQueueSignal);
+  if (full) {
     snprintf(lmic_event_msg + 14, LMIC_EVENTMSG_LEN - 14, "<>");
-    ESP_LOGW(TAG, "LORA sendqueue is full");
+    ESP_LOGW(TAG, "LORA sendqueue is full, message for port %d dropped",
+             dropped->MessagePort);
+    sendpool.release(dropped);
   } else {
     // add Lora send queue length to display
     snprintf(lmic_event_msg + 14, LMIC_EVENTMSG_LEN - 14, "%2u",
-             uxQueueMessagesWaiting(LoraSendQueue));
+             LoraSendQueue.waiting());
   }
 }
 
-void lora_queuereset(void) { xQueueReset(LoraSendQueue); }
+void lora_queuereset(void) {
+  MessageBuffer_t *message;
+  // give back our references to all waiting messages
+  xSemaphoreTake(LoraQueueLock, portMAX_DELAY);
+  while (LoraSendQueue.pop(message))
+    sendpool.release(message);
+  xSemaphoreGive(LoraQueueLock);
+}
+
+uint32_t lora_queuewaiting(void) { return LoraSendQueue.waiting(); }
 
-uint32_t lora_queuewaiting(void) {
-  return uxQueueMessagesWaiting(LoraSendQueue);
+// joined, and message of port is queued without dropping another one
+bool lora_queueready(uint8_t port) {
+  if (!LMIC.devaddr)
+    return false;
+  xSemaphoreTake(LoraQueueLock, portMAX_DELAY);
+  bool const room = LoraSendQueue.room(lora_prio(port));
+  xSemaphoreGive(LoraQueueLock);
+  return room;
 }
 
 // LMIC loop task
@@ -346,7 +661,7 @@ void myEventCallback(void *pUserData, ev_t ev) {
   // using message descriptors from LMIC library
   static const char *const evNames[] = {LMIC_EVENT_NAME_TABLE__INIT};
   // get current length of lora send queue
-  uint8_t const msgWaiting = uxQueueMessagesWaiting(LoraSendQueue);
+  uint8_t const msgWaiting = LoraSendQueue.waiting();
 
   // get current event message
   if (ev < sizeof(evNames) / sizeof(evNames[0]))
@@ -6,23 +6,41 @@
 // Local logging tag
 static const char TAG[] = __FILE__;
 
-static QueueHandle_t MacQueue;
-TaskHandle_t macProcessTask;
-
-static uint32_t salt = renew_salt();
+// counting core with MAC processing rings, duplicate filters and sketches,
+// shared with tools/replay, see maccounter.h
+static DRAM_ATTR MacCounter<MacSet_t> MacCore(macs, macs_wifi, macs_ble);
+static MacStats WifiStats, BleStats;
+static BeaconSet<0xff> BeaconIndex;
+
+#if (MAC_TRACE_SIZE)
+typedef struct {
+  hashedmac_t hashedmac; // hashed MAC, 0 if not counted
+  uint16_t wifi, ble;    // counters after processing
+  uint8_t mac[6];        // sniffed MAC
+  int8_t rssi;           // RSSI of sniffed MAC
+  uint8_t sniff_type;    // snifftype_t
+  uint8_t result;        // MAC_COUNT_xxx
+} MacTrace_t;
+
+static SpscRing<MacTrace_t, MAC_TRACE_SIZE> MacTraceRing;
+#endif
+TaskHandle_t macProcessTask = NULL;
 
 uint32_t renew_salt(void) {
-  salt = esp_random();
+  const uint32_t salt = esp_random();
   ESP_LOGV(TAG, "new salt = %04X", salt);
+  // window salt is taken on first call only, it must outlive the cycle salt
+  MacCore.rekey(salt, esp_random());
   return salt;
 }
 
-int8_t isBeacon(uint64_t mac) {
-  it = std::find(beacons.begin(), beacons.end(), mac);
-  if (it != beacons.end())
-    return std::distance(beacons.begin(), it);
-  else
-    return -1;
+// returns beacon ID if MAC is a known beacon, else -1
+int16_t isBeacon(const uint8_t *mac) { return BeaconIndex.find(mac); }
+
+// rebuild beacon lookup index, must be called after beacons array changed
+void mac_beacons_update(void) {
+  BeaconIndex.build(beacons.data());
+  ESP_LOGD(TAG, "Beacon index holds %d beacons", BeaconIndex.size());
 }
 
 // Display a key
@@ -45,13 +63,12 @@ uint64_t macConvert(uint8_t *paddr) {
 
 esp_err_t macQueueInit() {
   _ASSERT(MAC_QUEUE_SIZE > 0);
-  MacQueue = xQueueCreate(MAC_QUEUE_SIZE, sizeof(MacBuffer_t));
-  if (MacQueue == 0) {
-    ESP_LOGE(TAG, "Could not create MAC processing queue. Aborting.");
-    return ESP_FAIL;
-  }
-  ESP_LOGI(TAG, "MAC processing queue created, size %d Bytes",
-           MAC_QUEUE_SIZE * sizeof(MacBuffer_t));
+  // salt for MACs sniffed before first reset of counters, window salt is
+  // taken there, when RF is running and esp_random() is truly random
+  MacCore.rekey(esp_random(), 0);
+  mac_beacons_update();
+  ESP_LOGI(TAG, "MAC processing rings created, size %d Bytes",
+           2 * sizeof(MacRing_t));
 
   xTaskCreatePinnedToCore(mac_process,     // task function
                           "mac_process",   // name of task
@@ -61,62 +78,185 @@ esp_err_t macQueueInit() {
                           &macProcessTask, // task handle
                           1);              // CPU core
 
+#if (MAC_TRACE_SIZE)
+  xTaskCreatePinnedToCore(mac_trace,   // task function
+                          "mac_trace", // name of task
+                          3072,        // stack size of task
+                          (void *)1,   // parameter of the task
+                          0,           // priority of the task
+                          NULL,        // task handle
+                          1);          // CPU core
+#endif
+
   return ESP_OK;
 }
 
+// LED feedback for counted MACs, rate limited to keep per MAC cost low
+static void mac_blink(uint16_t color) {
+  static uint32_t last_blink = 0;
+  const uint32_t now = millis();
+  if (now - last_blink < MAC_BLINK_INTERVAL_MS)
+    return;
+  last_blink = now;
+  blink_LED(color, 50);
+}
+
+// record result of mac_analyze() for trace output, called by mac_process only
+static void mac_trace_add(const MacBuffer_t &MacBuffer, hashedmac_t hashedmac,
+                          uint8_t result) {
+#if (MAC_TRACE_SIZE)
+  MacTrace_t trace;
+  memcpy(trace.mac, MacBuffer.mac, 6);
+  trace.rssi = MacBuffer.rssi;
+  trace.sniff_type = MacBuffer.sniff_type;
+  trace.result = result;
+  trace.hashedmac = hashedmac;
+  trace.wifi = macs_wifi;
+  trace.ble = macs_ble;
+  MacTraceRing.push(trace); // if ring is full, trace is dropped
+#endif
+}
+
+#if (MAC_TRACE_SIZE)
+// low priority task formatting trace records of mac_analyze()
+void mac_trace(void *pvParameters) {
+  _ASSERT((uint32_t)pvParameters == 1); // FreeRTOS check
+
+  MacTrace_t t;
+
+  while (1) {
+    if (!MacTraceRing.empty()) {
+      while (MacTraceRing.pop(t)) {
+        if (t.result == MAC_COUNT_IGNORED) {
+          ESP_LOGV(TAG, "%s RSSI %d -> ignoring (limit: %d)",
+                   (t.sniff_type == MAC_SNIFF_WIFI) ? "WIFI" : "BLTH", t.rssi,
+                   cfg.rssilimit);
+          continue;
+        }
+        ESP_LOGV(TAG,
+                 "%s %s RSSI %ddBi -> MAC %0x:%0x:%0x:%0x:%0x:%0x"
+                 " -> hashed %04X -> WiFi:%d BLTH:%d",
+                 t.result == MAC_COUNT_NEW    ? "new  "
+                 : t.result == MAC_COUNT_FULL ? "full "
+                                              : "known",
+                 t.sniff_type == MAC_SNIFF_WIFI ? "WiFi" : "BLTH", t.rssi,
+                 t.mac[0], t.mac[1], t.mac[2], t.mac[3], t.mac[4], t.mac[5],
+                 t.hashedmac, t.wifi, t.ble);
+      }
+      ESP_LOGV(TAG,
+#if (COUNT_ENS)
+               "CWA:%d, "
+#endif
+               "%d Bytes left, %d traces dropped",
+#if (COUNT_ENS)
+               cwa_report(),
+#endif
+               getFreeRAM(), MacTraceRing.dropped());
+    }
+    delay(MAC_TRACE_INTERVAL_MS);
+  }
+}
+#endif
+
 // sniffed MAC processing task
 void mac_process(void *pvParameters) {
   _ASSERT((uint32_t)pvParameters == 1); // FreeRTOS check
 
   MacBuffer_t MacBuffer;
+  MacRing_t &WifiMacRing = MacCore.ring(MAC_SNIFF_WIFI);
+  MacRing_t &BleMacRing = MacCore.ring(MAC_SNIFF_BLE);
+  bool pending;
 
   while (1) {
 
-    // fetch next or wait for incoming MAC from sniffing queue
-    if (xQueueReceive(MacQueue, &MacBuffer, portMAX_DELAY) != pdTRUE) {
-      ESP_LOGE(TAG, "Premature return from xQueueReceive() with no data!");
-      continue;
-    }
+    // wait until a sniffer signals new MACs, timeout catches a notification
+    // which was skipped because the producer saw a non empty ring
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MAC_RING_TIMEOUT_MS));
 
     // update traffic indicator
-    rf_load = uxQueueMessagesWaiting(MacQueue);
-    // process fetched mac
-    mac_analyze(MacBuffer);
+    WifiStats.occupancy(WifiMacRing.waiting());
+    BleStats.occupancy(BleMacRing.waiting());
+    rf_load = WifiMacRing.waiting() + BleMacRing.waiting();
+
+    // drain both rings in batches, alternating between them
+    do {
+      pending = false;
+      for (uint8_t i = 0; i < MAC_BATCH_SIZE; i++) {
+        if (!WifiMacRing.pop(MacBuffer))
+          break;
+        WifiStats.record((uint32_t)esp_timer_get_time() - MacBuffer.stamp);
+        mac_analyze(MacBuffer);
+        pending = true;
+      }
+      for (uint8_t i = 0; i < MAC_BATCH_SIZE; i++) {
+        if (!BleMacRing.pop(MacBuffer))
+          break;
+        BleStats.record((uint32_t)esp_timer_get_time() - MacBuffer.stamp);
+        mac_analyze(MacBuffer);
+        pending = true;
+      }
+    } while (pending);
   }
   delay(2); // yield to CPU
 }
 
-// enqueue message in MAC processing queue
+// enqueue message in MAC processing ring
 void IRAM_ATTR mac_add(uint8_t *paddr, int8_t rssi, snifftype_t sniff_type) {
 
-  MacBuffer_t MacBuffer;
+  // wake up MAC processing task only if it may have drained the ring before
+  if (MacCore.add(paddr, rssi, sniff_type, (uint32_t)esp_timer_get_time(),
+                  cfg.rssilimit, cfg.monitormode) == MAC_ADD_WAKE &&
+      macProcessTask)
+    xTaskNotifyGive(macProcessTask);
+}
+
+// clear MAC container, counters, sketches and duplicate filters, must be
+// called when a new count cycle starts. Duplicate filters are emptied by the
+// sniffer callbacks, so this may be called from any task.
+void mac_reset(void) { MacCore.reset(); }
 
-  MacBuffer.rssi = rssi;
-  MacBuffer.sniff_type = sniff_type;
-  memcpy(MacBuffer.mac, paddr, 6);
+// current time bucket of sliding window
+uint32_t mac_window_epoch(void) { return MacCore.epoch(millis()); }
 
-  if (xQueueSendToBackFromISR(MacQueue, (void *)&MacBuffer, (TickType_t)0) !=
-      pdPASS)
-    ESP_LOGW(TAG, "Dense radio traffic, packet lost!");
+// estimated unique MACs seen in the last <minutes>, rounded up to buckets
+uint16_t mac_window_count(uint8_t minutes) {
+  return MacCore.window_count(minutes, millis());
 }
 
-uint16_t mac_analyze(MacBuffer_t MacBuffer) {
+// number of frames dropped as repeats by early duplicate filter
+uint32_t mac_dedup_hits(snifftype_t sniff_type) {
+  return MacCore.dedup_hits(sniff_type);
+}
 
-  uint32_t *mac; // pointer to shortened 4 byte MAC
-  uint32_t saltedmac;
-  uint16_t hashedmac;
+// number of frames passed by early duplicate filter
+uint32_t mac_dedup_misses(snifftype_t sniff_type) {
+  return MacCore.dedup_misses(sniff_type);
+}
 
-  if ((cfg.rssilimit) &&
-      (MacBuffer.rssi < cfg.rssilimit)) { // rssi is negative value
-    ESP_LOGI(TAG, "%s RSSI %d -> ignoring (limit: %d)",
-             (MacBuffer.sniff_type == MAC_SNIFF_WIFI) ? "WIFI" : "BLTH",
-             MacBuffer.rssi, cfg.rssilimit);
-    return 0;
-  }
+// snapshot of MAC pipeline statistics, clears latency histogram and peak
+void mac_pipeline_status(pipelineStatus_t *status, snifftype_t sniff_type) {
+  MacStats &stats = (sniff_type == MAC_SNIFF_WIFI) ? WifiStats : BleStats;
+  status->analyzed = stats.count();
+  status->dropped = mac_drops(sniff_type);
+  status->filtered = mac_dedup_hits(sniff_type);
+  status->p50 = stats.percentile(50);
+  status->p99 = stats.percentile(99);
+  status->peak = stats.peak();
+  stats.clear();
+}
+
+// number of MACs lost due to full processing rings
+uint32_t mac_drops(snifftype_t sniff_type) {
+  return MacCore.drops(sniff_type);
+}
+
+hashedmac_t mac_analyze(MacBuffer_t MacBuffer) {
+
+  hashedmac_t hashedmac;
 
   // in beacon monitor mode check if seen MAC is a known beacon
-  if (cfg.monitormode) {
-    int8_t beaconID = isBeacon(macConvert(MacBuffer.mac));
+  if (cfg.monitormode && !(cfg.rssilimit && MacBuffer.rssi < cfg.rssilimit)) {
+    int16_t beaconID = isBeacon(MacBuffer.mac);
     if (beaconID >= 0) {
       ESP_LOGI(TAG, "Beacon ID#%d detected", beaconID);
       blink_LED(COLOR_WHITE, 2000);
@@ -126,46 +266,34 @@ uint16_t mac_analyze(MacBuffer_t MacBuffer) {
     }
   };
 
-  // only last 3 MAC Address bytes are used for MAC address anonymization
-  // but since it's uint32 we take 4 bytes to avoid 1st value to be 0.
-  // this gets MAC in msb (= reverse) order, but doesn't matter for hashing it.
-  mac = (uint32_t *)(MacBuffer.mac + 2);
-
   // salt and hash MAC, and if new unique one, store identifier in container
   // and increment counter on display
-  // https://en.wikipedia.org/wiki/MAC_Address_Anonymization
-
-  // reversed 4 byte MAC added to current salt
-  saltedmac = *mac + salt;
+  const uint8_t result =
+      MacCore.analyze(MacBuffer, cfg.rssilimit, cfg.countermode == 1,
+                      mac_window_epoch(), hashedmac);
 
-  // hashed 4 byte MAC
-  // to save RAM, we use only lower 2 bytes of hash, since collisions don't
-  // matter in our use case
-  hashedmac = myhash((const char *)&saltedmac, 4);
-
-  auto newmac = macs.insert(hashedmac); // add hashed MAC, if new unique
-  bool added =
-      newmac.second ? true : false; // true if hashed MAC is unique in container
+  // with 24 / 32 bit, new MACs are rejected once the table is full
+  if (result == MAC_COUNT_FULL && macs.overflow() == 1)
+    ESP_LOGW(TAG, "MAC container full at %d MACs, further new MACs are not "
+                  "counted this cycle, raise MAC_SET_CROWD",
+             macs.size());
 
   // Count only if MAC was not yet seen
-  if (added) {
+  if (result == MAC_COUNT_NEW) {
 
     switch (MacBuffer.sniff_type) {
 
     case MAC_SNIFF_WIFI:
-      macs_wifi++; // increment Wifi MACs counter
-      blink_LED(COLOR_GREEN, 50);
+      mac_blink(COLOR_GREEN);
       break;
 
     case MAC_SNIFF_BLE:
-      macs_ble++; // increment BLE Macs counter
-      blink_LED(COLOR_MAGENTA, 50);
+      mac_blink(COLOR_MAGENTA);
       break;
 #if (COUNT_ENS)
     case MAC_SNIFF_BLE_ENS:
-      macs_ble++;             // increment BLE Macs counter
       cwa_mac_add(hashedmac); // process ENS beacon
-      blink_LED(COLOR_WHITE, 50);
+      mac_blink(COLOR_WHITE);
       break;
 #endif
     default:
@@ -174,25 +302,9 @@ uint16_t mac_analyze(MacBuffer_t MacBuffer) {
     } // switch
   }   // added
 
-  // Log scan result
-  ESP_LOGV(TAG,
-           "%s %s RSSI %ddBi -> MAC %0x:%0x:%0x:%0x:%0x:%0x -> salted %04X"
-           " -> hashed %04X -> WiFi:%d  "
-           "BLTH:%d "
-#if (COUNT_ENS)
-           "(CWA:%d)"
-#endif
-           "-> %d Bytes left",
-           added ? "new  " : "known",
-           MacBuffer.sniff_type == MAC_SNIFF_WIFI ? "WiFi" : "BLTH",
-           MacBuffer.rssi, MacBuffer.mac[0], MacBuffer.mac[1], MacBuffer.mac[2],
-           MacBuffer.mac[3], MacBuffer.mac[4], MacBuffer.mac[5], saltedmac,
-           hashedmac, macs_wifi, macs_ble,
-#if (COUNT_ENS)
-           cwa_report(),
-#endif
-           getFreeRAM());
+  // log scan result, formatted later by trace task
+  mac_trace_add(MacBuffer, hashedmac, result);
 
   // if an unknown Wifi or BLE mac was counted, return hash of this mac, else 0
-  return (added ? hashedmac : 0);
+  return (result == MAC_COUNT_NEW ? hashedmac : 0);
 }
@@ -106,9 +106,8 @@ SemaphoreHandle_t I2Caccess;
 bool volatile TimePulseTick = false;
 timesource_t timeSource = _unsynced;
 
-// container holding unique MAC address hashes with Memory Alloctor using PSRAM,
-// if present
-DRAM_ATTR std::set<uint16_t, std::less<uint16_t>, Mallocator<uint16_t>> macs;
+// container holding unique MAC address hashes
+DRAM_ATTR MacSet_t macs;
 
 // initialize payload encoder
 PayloadConvert payload(PAYLOAD_BUFFER_SIZE);
@@ -414,6 +413,12 @@ void setup() {
   _ASSERT(mqtt_init() == ESP_OK);
 #endif
 
+// initialize flash spool for backlogged transports
+#if (SEND_SPOOL)
+  if (spool_init() == ESP_OK)
+    strcat_P(features, " SPOOL");
+#endif
+
 #if (HAS_SDCARD)
   if (sdcard_init())
     strcat_P(features, " SD");
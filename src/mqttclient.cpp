@@ -5,14 +5,20 @@
 static const char TAG[] = __FILE__;
 
 static QueueHandle_t MQTTSendQueue;
+static const uint32_t MQTTOutboxSize[] = {SEND_QUEUE_SIZE};
+static MqttOutbox_t MQTTOutbox(MQTTOutboxSize);
+static SemaphoreHandle_t MQTTOutboxLock;
+static char MQTTPayload[MQTT_PAYLOAD_SIZE]; // message or batch being published
+static volatile bool mqttOnline = false;     // connection state for other tasks
 TaskHandle_t mqttTask;
 
 Ticker mqttTimer;
 WiFiClient netClient;
-MQTTClient mqttClient;
+MQTTClient mqttClient(MQTT_PAYLOAD_SIZE + 32); // room for payload, topic, header
 
 void mqtt_deinit(void) {
   mqttClient.unsubscribe(MQTT_INTOPIC);
+  mqttClient.unsubscribe(MQTT_INTOPIC_RAW);
   mqttClient.onMessageAdvanced(NULL);
   mqttClient.disconnect();
   vTaskDelete(mqttTask);
@@ -27,13 +33,14 @@ esp_err_t mqtt_init(void) {
   mqttClient.onMessageAdvanced(mqtt_callback);
 
   _ASSERT(SEND_QUEUE_SIZE > 0);
-  MQTTSendQueue = xQueueCreate(SEND_QUEUE_SIZE, sizeof(MessageBuffer_t));
-  if (MQTTSendQueue == 0) {
+  MQTTSendQueue = xQueueCreate(SEND_QUEUE_SIZE, sizeof(MessageBuffer_t *));
+  MQTTOutboxLock = xSemaphoreCreateMutex();
+  if (MQTTSendQueue == 0 || MQTTOutboxLock == NULL) {
     ESP_LOGE(TAG, "Could not create MQTT send queue. Aborting.");
     return ESP_FAIL;
   }
   ESP_LOGI(TAG, "MQTT send queue created, size %d Bytes",
-           SEND_QUEUE_SIZE * PAYLOAD_BUFFER_SIZE);
+           SEND_QUEUE_SIZE * sizeof(MessageBuffer_t *));
 
   ESP_LOGI(TAG, "Starting MQTTloop...");
   xTaskCreatePinnedToCore(mqtt_client_task, "mqttloop", 4096, (void *)NULL, 1,
@@ -67,8 +74,10 @@ int mqtt_connect(const char *my_host, const uint16_t my_port) {
     mqttClient.publish(MQTT_OUTTOPIC, MQTT_CLIENTNAME);
     // Clear retained messages that may have been published earlier on topic
     mqttClient.publish(MQTT_INTOPIC, "", true, 1);
+    mqttClient.publish(MQTT_INTOPIC_RAW, "", true, 1);
     mqttClient.subscribe(MQTT_INTOPIC);
-    ESP_LOGI(TAG, "MQTT topic subscribed");
+    mqttClient.subscribe(MQTT_INTOPIC_RAW);
+    ESP_LOGI(TAG, "MQTT topics subscribed");
   } else {
     ESP_LOGD(TAG, "MQTT last_error = %d / rc = %d", mqttClient.lastError(),
              mqttClient.returnCode());
@@ -79,80 +88,177 @@ int mqtt_connect(const char *my_host, const uint16_t my_port) {
   return 0;
 }
 
+// moves queued messages into outbox, waits up to timeout for the first one
+static void mqtt_fetch(TickType_t timeout) {
+  MessageBuffer_t *msg, *evicted;
+  bool dropped;
+
+  while (xQueueReceive(MQTTSendQueue, &msg, timeout) == pdTRUE) {
+    timeout = 0;
+    xSemaphoreTake(MQTTOutboxLock, portMAX_DELAY);
+    dropped = MQTTOutbox.push(msg, 0, evicted);
+    xSemaphoreGive(MQTTOutboxLock);
+    if (dropped) {
+      sendpool.release(evicted);
+      ESP_LOGW(TAG, "MQTT outbox is full, oldest message dropped");
+    }
+  }
+}
+
+// wire format of messages sent on a port
+static uint8_t mqtt_format(uint8_t port) {
+#ifdef MQTT_RAW_PORTS
+  static const uint8_t raw[] = {MQTT_RAW_PORTS};
+  for (uint8_t p : raw)
+    if (p == port)
+      return MQTT_FORMAT_RAW;
+#endif
+#ifdef MQTT_JSON_PORTS
+  static const uint8_t json[] = {MQTT_JSON_PORTS};
+  for (uint8_t p : json)
+    if (p == port)
+      return MQTT_FORMAT_JSON;
+#endif
+  return MQTT_FORMAT;
+}
+
+// publishes oldest message of outbox, or oldest messages as one batch
+static void mqtt_publish(void) {
+  MessageBuffer_t *batch[MQTT_BATCH_MAX];
+  char topic[16];
+  uint16_t len;
+  uint8_t n;
+  bool sent;
+
+  xSemaphoreTake(MQTTOutboxLock, portMAX_DELAY);
+  n = mqtt_batch(MQTTOutbox, batch, MQTT_BATCH_MAX, MQTTPayload,
+                 MQTT_PAYLOAD_SIZE, &len,
+                 [](const MessageBuffer_t *msg, bool first, char *out,
+                    uint16_t size) {
+                   // field layouts are known for plain and packed format
+                   return mqtt_encode<PAYLOAD_MSB>(
+                       msg, mqtt_format(msg->MessagePort), first,
+                       MQTT_BATCH_MAX > 1, out, size, PAYLOAD_ENCODER <= 2);
+                 });
+  // keep messages while publishing, outbox may drop them meanwhile
+  for (uint8_t i = 0; i < n; i++)
+    sendpool.retain(batch[i]);
+  xSemaphoreGive(MQTTOutboxLock);
+  if (!n)
+    return;
+
+  // send encoded messages to mqtt server, QoS 1 waits for broker's ack
+  snprintf(topic, 16, "%s/%u", MQTT_OUTTOPIC, batch[0]->MessagePort);
+  sent = mqttClient.publish(topic, MQTTPayload, len, false, MQTT_QOS);
+  if (sent)
+    ESP_LOGD(TAG, "%u message(s), %u bytes sent to MQTT server", n, len);
+  else
+    ESP_LOGD(TAG, "Couldn't sent message to MQTT server");
+
+  // delete sent messages from outbox, give back our references
+  xSemaphoreTake(MQTTOutboxLock, portMAX_DELAY);
+  for (uint8_t i = 0; i < n; i++) {
+    if (sent && MQTTOutbox.remove(batch[i]))
+      sendpool.release(batch[i]);
+    sendpool.release(batch[i]);
+  }
+  xSemaphoreGive(MQTTOutboxLock);
+}
+
+static uint32_t mqtt_outboxwaiting(void) {
+  xSemaphoreTake(MQTTOutboxLock, portMAX_DELAY);
+  uint32_t const n = MQTTOutbox.waiting();
+  xSemaphoreGive(MQTTOutboxLock);
+  return n;
+}
+
 void mqtt_client_task(void *param) {
 
-  MessageBuffer_t msg;
+  uint32_t retry_ms = MQTT_RETRY_MIN_MS;
+  unsigned long retry_at = millis();
 
   while (1) {
 
-    if (mqttClient.connected()) {
+    mqttOnline = mqttClient.connected();
+    if (mqttOnline) {
 
       // check for incoming messages
       mqttClient.loop();
+      retry_ms = MQTT_RETRY_MIN_MS;
 
       // fetch next or wait for payload to send from queue
-      // do not delete item from queue until it is transmitted
       // consider mqtt timeout while waiting
-      if (xQueuePeek(MQTTSendQueue, &msg,
-                     MQTT_KEEPALIVE * 1000 / portTICK_PERIOD_MS) != pdTRUE)
-        continue;
+      mqtt_fetch(mqtt_outboxwaiting() ? 0
+                                      : MQTT_KEEPALIVE * 1000 /
+                                            portTICK_PERIOD_MS);
+      mqtt_publish();
 
-      // prepare mqtt topic
-      char topic[16];
-      snprintf(topic, 16, "%s/%u", MQTT_OUTTOPIC, msg.MessagePort);
-      size_t out_len = 0;
-
-      // get length of base64 encoded message
-      mbedtls_base64_encode(NULL, 0, &out_len, (unsigned char *)msg.Message,
-                            msg.MessageSize);
-
-      // base64 encode the message
-      unsigned char encoded[out_len];
-      mbedtls_base64_encode(encoded, out_len, &out_len,
-                            (unsigned char *)msg.Message, msg.MessageSize);
-
-      // send encoded message to mqtt server and delete it from queue
-      if (mqttClient.publish(topic, (const char *)encoded, out_len)) {
-        ESP_LOGD(TAG, "%u bytes sent to MQTT server", out_len);
-        xQueueReceive(MQTTSendQueue, &msg, (TickType_t)0);
-      } else
-        ESP_LOGD(TAG, "Couldn't sent message to MQTT server");
     } else {
-      // attempt to reconnect to MQTT server
+      long const wait = (long)(retry_at - millis());
+
+      // keep outbox filled from queue until next attempt
+      if (wait > 0) {
+        mqtt_fetch(wait / portTICK_PERIOD_MS);
+        continue;
+      }
+
+      // attempt to reconnect to MQTT server, back off while it fails
       ESP_LOGD(TAG, "MQTT client reconnecting...");
-      delay(MQTT_RETRYSEC * 1000);
-      mqtt_connect(MQTT_SERVER, MQTT_PORT);
+      if (mqtt_connect(MQTT_SERVER, MQTT_PORT) != 0) {
+        retry_at = millis() + retry_ms;
+        retry_ms = min(2 * retry_ms, (uint32_t)MQTT_RETRYSEC * 1000);
+      }
     }
+
   } // while (1)
 }
 
-// process incoming MQTT messages
+// process incoming MQTT messages, base64 or raw commands
 void mqtt_callback(MQTTClient *client, char *topic, char *payload, int length) {
-  if (strcmp(topic, MQTT_INTOPIC) == 0) {
-
-    // get length of base64 encoded message
-    size_t out_len = 0;
-    mbedtls_base64_decode(NULL, 0, &out_len, (unsigned char *)payload, length);
+  uint8_t decoded[MQTT_PAYLOAD_SIZE / 4 * 3];
+  int len;
 
+  if (strcmp(topic, MQTT_INTOPIC) == 0) {
     // decode the base64 message
-    unsigned char decoded[out_len];
-    mbedtls_base64_decode(decoded, out_len, &out_len, (unsigned char *)payload,
-                          length);
-
-    rcommand(decoded, out_len);
-  }
+    len = base64_get(decoded, sizeof(decoded), payload, length);
+    if (len > 0)
+      rcommand(decoded, len);
+    else if (len < 0)
+      ESP_LOGW(TAG, "Invalid base64 command received");
+  } else if (strcmp(topic, MQTT_INTOPIC_RAW) == 0 && length > 0)
+    rcommand((const uint8_t *)payload, length);
 }
 
 // enqueue outgoing messages in MQTT send queue
 void mqtt_enqueuedata(MessageBuffer_t *message) {
-  if (xQueueSendToBack(MQTTSendQueue, (void *)message, (TickType_t)0) != pdTRUE)
+  if (xQueueSendToBack(MQTTSendQueue, (void *)&message, (TickType_t)0) !=
+      pdTRUE) {
+    sendpool.release(message);
     ESP_LOGW(TAG, "MQTT sendqueue is full");
+  }
 }
 
-void mqtt_queuereset(void) { xQueueReset(MQTTSendQueue); }
+void mqtt_queuereset(void) {
+  MessageBuffer_t *message;
+  // give back our references to all waiting messages
+  while (xQueueReceive(MQTTSendQueue, &message, (TickType_t)0) == pdTRUE)
+    sendpool.release(message);
+  xSemaphoreTake(MQTTOutboxLock, portMAX_DELAY);
+  while (MQTTOutbox.pop(message))
+    sendpool.release(message);
+  xSemaphoreGive(MQTTOutboxLock);
+}
 
+// messages waiting in queue or outbox
 uint32_t mqtt_queuewaiting(void) {
-  return uxQueueMessagesWaiting(MQTTSendQueue);
+  return uxQueueMessagesWaiting(MQTTSendQueue) + mqtt_outboxwaiting();
+}
+
+// connected, and message is queued without outbox dropping another one
+bool mqtt_queueready(uint8_t port) {
+  return mqttOnline && uxQueueSpacesAvailable(MQTTSendQueue) > 0 &&
+         uxQueueMessagesWaiting(MQTTSendQueue) + mqtt_outboxwaiting() <
+             SEND_QUEUE_SIZE;
 }
 
 #endif // HAS_MQTT
\ No newline at end of file
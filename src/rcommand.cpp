@@ -206,6 +206,7 @@ void set_beacon(uint8_t val[]) {
   uint8_t id = val[0];           // use first parameter as beacon storage id
   memmove(val, val + 1, 6);      // strip off storage id
   beacons[id] = macConvert(val); // store beacon MAC in array
+  mac_beacons_update();          // and make it visible to MAC processing
   ESP_LOGI(TAG, "Remote command: set beacon ID#%d", id);
   printKey("MAC", val, 6, false); // show beacon MAC
 }
@@ -338,6 +339,16 @@ void get_status(uint8_t val[]) {
   SendPayload(STATUSPORT);
 };
 
+void get_pipeline(uint8_t val[]) {
+  ESP_LOGI(TAG, "Remote command: get MAC pipeline statistics");
+  pipelineStatus_t wifi, ble;
+  mac_pipeline_status(&wifi, MAC_SNIFF_WIFI);
+  mac_pipeline_status(&ble, MAC_SNIFF_BLE);
+  payload.reset();
+  payload.addPipeline(wifi, ble);
+  SendPayload(STATUSPORT);
+};
+
 void get_gps(uint8_t val[]) {
   ESP_LOGI(TAG, "Remote command: get gps status");
 #if (HAS_GPS)
@@ -432,7 +443,7 @@ static const cmd_t table[] = {
     {0x81, get_status, 0},        {0x83, get_batt, 0},
     {0x84, get_gps, 0},           {0x85, get_bme, 0},
     {0x86, get_time, 0},          {0x87, set_time, 0},
-    {0x99, set_flush, 0}};
+    {0x88, get_pipeline, 0},      {0x99, set_flush, 0}};
 
 static const uint8_t cmdtablesize =
     sizeof(table) / sizeof(table[0]); // number of commands in command table
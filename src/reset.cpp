@@ -24,6 +24,9 @@ void reset_rtc_vars(void) {
 }
 
 void do_reset(bool warmstart) {
+#if (HAS_SDCARD)
+  sdcard_flush();
+#endif
   if (warmstart) {
     ESP_LOGI(TAG, "restarting device (warmstart)");
   } else {
@@ -151,6 +154,11 @@ void enter_deepsleep(const uint64_t wakeup_sec, gpio_num_t wakeup_gpio) {
   mqtt_deinit();
 #endif
 
+// write buffered data to SD-card
+#if (HAS_SDCARD)
+  sdcard_flush();
+#endif
+
 // shutdown SPI safely
 #ifdef HAS_SPI
   spi_deinit();
@@ -7,11 +7,89 @@ static const char TAG[] = __FILE__;
 
 #ifdef HAS_SDCARD
 
+#if HAS_SDCARD == 1
+#define SDCard SD
+#elif HAS_SDCARD == 2
+#define SDCard SD_MMC
+#endif
+
+// writes log file, for SdLog. FILE_WRITE does not force appending, so a
+// partial last sector is overwritten in place, unless sdcard_init() found the
+// library appends anyway.
+class SdFileWriter {
+
+public:
+  File file;
+
+  bool open(const char *name) {
+    file = SDCard.open(name, FILE_WRITE);
+    end = 0;
+    ok = true;
+    return file ? true : false;
+  }
+  bool write(uint32_t pos, const uint8_t *data, uint32_t len) {
+    if ((file.position() != pos && !file.seek(pos)) ||
+        file.write(data, len) != len)
+      return ok = false;
+    if (pos + len > end)
+      end = pos + len;
+    return true;
+  }
+  // true if all writes since last sync made it, and file has expected size
+  bool sync(void) {
+    file.flush();
+    bool const synced = ok && file.size() == end;
+    ok = true;
+    return synced;
+  }
+
+private:
+  uint32_t end; // expected file size
+  bool ok;      // no write failed since last sync
+};
+
 static bool useSDCard;
+static SemaphoreHandle_t SDCardLock = NULL;
+static SdFileWriter sdFile;
+static SdLog<SdFileWriter, SDCARD_BUFFER_SECTORS> sdLog(sdFile);
+static uint32_t sdFileDay = 0; // day the log file was opened, 0 if unknown
+static unsigned long sdSyncAt = 0;
+
+// fields of binary records
+static const uint8_t sdFields = 0
+#if (COUNT_ENS)
+                                | SDLOG_CWA
+#endif
+#if (HAS_SDS011)
+                                | SDLOG_SDS011
+#endif
+    ;
+
+static bool createFile(void);
 
-static void createFile(void);
+// checks if data written to a file can be overwritten in place, some card
+// libraries append every write to the end of the file
+static bool sdcard_overwrites(void) {
+  uint8_t buffer[8];
+  bool ok = false;
 
-File fileSDCard;
+  SDCard.remove(SDCARD_PROBE_NAME);
+  File probe = SDCard.open(SDCARD_PROBE_NAME, FILE_WRITE);
+  if (probe) {
+    ok = probe.write((const uint8_t *)"12345678", 8) == 8 && probe.seek(0) &&
+         probe.write((const uint8_t *)"ab", 2) == 2;
+    probe.close();
+  }
+  probe = SDCard.open(SDCARD_PROBE_NAME, FILE_READ);
+  if (probe) {
+    ok = ok && probe.size() == 8 && probe.read(buffer, 8) == 8 &&
+         !memcmp(buffer, "ab345678", 8);
+    probe.close();
+  } else
+    ok = false;
+  SDCard.remove(SDCARD_PROBE_NAME);
+  return ok;
+}
 
 bool sdcard_init() {
   ESP_LOGI(TAG, "looking for SD-card...");
@@ -31,92 +109,156 @@ bool sdcard_init() {
   useSDCard = SD_MMC.begin();
 #endif
 
-  if (useSDCard) {
+  SDCardLock = xSemaphoreCreateMutex();
+  if (useSDCard && SDCardLock != NULL) {
     ESP_LOGI(TAG, "SD-card found");
-    createFile();
-  } else
+    if (!sdcard_overwrites()) {
+      ESP_LOGW(TAG, "SD: card library appends all writes, log is appended");
+      sdLog.appendonly(true);
+    }
+    useSDCard = createFile();
+  } else {
+    useSDCard = false;
     ESP_LOGI(TAG, "SD-card not found");
+  }
   return useSDCard;
 }
 
+static uint32_t dayOf(time_t t) {
+  return timeStatus() == timeNotSet ? 0 : t / SECS_PER_DAY;
+}
+
 void sdcardWriteData(uint16_t noWifi, uint16_t noBle,
                      __attribute__((unused)) uint16_t noBleCWA) {
-  static int counterWrites = 0;
-  char tempBuffer[12 + 1];
   time_t t = now();
 #if (HAS_SDS011)
   sdsStatus_t sds;
+  sds011_store(&sds);
 #endif
 
   if (!useSDCard)
     return;
 
+  xSemaphoreTake(SDCardLock, portMAX_DELAY);
+
+  // start next file at size limit, or at change of date
+  if (sdLog.size() >= SDCARD_FILE_KB * 1024UL ||
+      (SDCARD_FILE_DAILY && dayOf(t) && dayOf(t) != sdFileDay)) {
+    if (!sdLog.flush())
+      ESP_LOGW(TAG, "SD: could not write end of file");
+    sdFile.file.close();
+    if (!createFile()) {
+      ESP_LOGW(TAG, "SD: could not open next file, logging stopped");
+      useSDCard = false;
+      xSemaphoreGive(SDCardLock);
+      return;
+    }
+  }
+
   ESP_LOGD(TAG, "writing to SD-card");
-  sprintf(tempBuffer, "%02d.%02d.%4d,", day(t), month(t), year(t));
-  fileSDCard.print(tempBuffer);
-  sprintf(tempBuffer, "%02d:%02d:%02d,", hour(t), minute(t), second(t));
-  fileSDCard.print(tempBuffer);
-  sprintf(tempBuffer, "%d,%d", noWifi, noBle);
-  fileSDCard.print(tempBuffer);
+#if (SDCARD_FORMAT == 1)
+  uint8_t rec[sizeof(SdLogRecord_t)];
+  SdLogRecord_t r = {(uint32_t)t, noWifi, noBle, noBleCWA, 0, 0};
+#if (HAS_SDS011)
+  r.pm10 = sds.pm10 * 10 + 0.5;
+  r.pm25 = sds.pm25 * 10 + 0.5;
+#endif
+  sdLog.record(sdFields, rec, sdlog_encode(rec, r, sdFields));
+#else
+  char line[64];
+  int n = snprintf(line, sizeof(line), "%02d.%02d.%4d,%02d:%02d:%02d,%d,%d",
+                   day(t), month(t), year(t), hour(t), minute(t), second(t),
+                   noWifi, noBle);
 #if (COUNT_ENS)
-  sprintf(tempBuffer, ",%d", noBleCWA);
-  fileSDCard.print(tempBuffer);
+  n += snprintf(line + n, sizeof(line) - n, ",%d", noBleCWA);
 #endif
 #if (HAS_SDS011)
-  sds011_store(&sds);
-  sprintf(tempBuffer, ",%5.1f,%4.1f", sds.pm10, sds.pm25);
-  fileSDCard.print(tempBuffer);
+  n += snprintf(line + n, sizeof(line) - n, ",%5.1f,%4.1f", sds.pm10,
+                sds.pm25);
+#endif
+  n += snprintf(line + n, sizeof(line) - n, "\r\n");
+  sdLog.text(line, n);
 #endif
-  fileSDCard.println();
 
-  if (++counterWrites > 2) {
-    // force writing to SD-card
+  // write through to card once in a while, sectors in between
+  if (millis() - sdSyncAt >= SDCARD_SYNC_SEC * 1000UL) {
     ESP_LOGD(TAG, "flushing data to card");
-    fileSDCard.flush();
-    counterWrites = 0;
+    if (!sdLog.flush())
+      ESP_LOGW(TAG, "SD: could not write buffered data to card");
+    sdSyncAt = millis();
   }
+
+  xSemaphoreGive(SDCardLock);
 }
 
-void createFile(void) {
-  char bufferFilename[8 + 1 + 3 + 1];
+// writes buffered data to card, before sleep or reset
+void sdcard_flush(void) {
+  if (!useSDCard)
+    return;
+  xSemaphoreTake(SDCardLock, portMAX_DELAY);
+  if (!sdLog.flush())
+    ESP_LOGW(TAG, "SD: could not write buffered data to card");
+  sdSyncAt = millis();
+  xSemaphoreGive(SDCardLock);
+}
 
-  useSDCard = false;
+// returns number of next log file and stores it in index file. Probes file
+// names only if the index file was lost.
+static uint32_t nextFile(void) {
+  char buffer[16];
+  uint32_t n = 0;
+  int len;
 
-  for (int i = 0; i < 100; i++) {
-    sprintf(bufferFilename, SDCARD_FILE_NAME, i);
-    // ESP_LOGD(TAG, "SD: looking for file <%s>", bufferFilename);
+  File index = SDCard.open(SDCARD_INDEX_NAME, FILE_READ);
+  if (index) {
+    len = index.read((uint8_t *)buffer, sizeof(buffer) - 1);
+    index.close();
+    buffer[len > 0 ? len : 0] = 0;
+    n = strtoul(buffer, NULL, 10);
+  }
+  if (!n) {
+    ESP_LOGI(TAG, "SD: no index file, looking for last file");
+    do
+      snprintf(buffer, sizeof(buffer), SDCARD_FILE_NAME, ++n);
+    while (n < SDCARD_FILE_COUNT && SDCard.exists(buffer));
+    n--;
+  }
+  n = n % SDCARD_FILE_COUNT + 1;
 
-#if HAS_SDCARD == 1
-    bool fileExists = SD.exists(bufferFilename);
-#elif HAS_SDCARD == 2
-    bool fileExists = SD_MMC.exists(bufferFilename);
-#endif
+  SDCard.remove(SDCARD_INDEX_NAME);
+  index = SDCard.open(SDCARD_INDEX_NAME, FILE_WRITE);
+  if (index) {
+    len = snprintf(buffer, sizeof(buffer), "%u\r\n", n);
+    index.write((const uint8_t *)buffer, len);
+    index.close();
+  }
+  return n;
+}
 
-    if (!fileExists) {
-      // ESP_LOGD(TAG, "SD: file does not exist: opening");
+static bool createFile(void) {
+  char bufferFilename[16];
 
-#if HAS_SDCARD == 1
-      fileSDCard = SD.open(bufferFilename, FILE_WRITE);
-#elif HAS_SDCARD == 2
-      fileSDCard = SD_MMC.open(bufferFilename, FILE_WRITE);
-#endif
+  snprintf(bufferFilename, sizeof(bufferFilename), SDCARD_FILE_NAME,
+           nextFile());
+  SDCard.remove(bufferFilename); // left over from before numbers wrapped
+  if (!sdFile.open(bufferFilename))
+    return false;
 
-      if (fileSDCard) {
-        ESP_LOGD(TAG, "SD: name opened: <%s>", bufferFilename);
-        fileSDCard.print(SDCARD_FILE_HEADER);
+  ESP_LOGD(TAG, "SD: name opened: <%s>", bufferFilename);
+  sdLog.start();
+  sdFileDay = dayOf(now());
+#if (SDCARD_FORMAT == 0)
+  sdLog.text(SDCARD_FILE_HEADER, strlen(SDCARD_FILE_HEADER));
 #if (COUNT_ENS)
-        fileSDCard.print(SDCARD_FILE_HEADER_CWA); // for Corona-data (CWA)
+  // for Corona-data (CWA)
+  sdLog.text(SDCARD_FILE_HEADER_CWA, strlen(SDCARD_FILE_HEADER_CWA));
 #endif
 #if (HAS_SDS011)
-        fileSDCard.print(SDCARD_FILE_HEADER_SDS011);
+  sdLog.text(SDCARD_FILE_HEADER_SDS011, strlen(SDCARD_FILE_HEADER_SDS011));
 #endif
-        fileSDCard.println();
-        useSDCard = true;
-        break;
-      }
-    }
-  }
-  return;
+  sdLog.text("\r\n", 2);
+#endif
+  return true;
 }
 
 #endif // (HAS_SDCARD)
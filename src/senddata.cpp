@@ -3,58 +3,81 @@
 
 Ticker sendTimer;
 
+SendPool_t sendpool;
+
 void setSendIRQ() {
   xTaskNotify(irqHandlerTask, SENDCYCLE_IRQ, eSetBits);
 }
 
 // put data to send in RTos Queues used for transmit over channels Lora and SPI
-void SendPayload(uint8_t port) {
-
-  ESP_LOGD(TAG, "sending Payload for Port %d", port);
-
-  MessageBuffer_t SendBuffer; // contains MessageSize, MessagePort, Message[]
+static void EnqueuePayload(uint8_t port, const uint8_t *data, uint8_t size) {
 
-  SendBuffer.MessageSize = payload.getSize();
+#if (SEND_TRANSPORTS)
+  uint8_t msgport, spooled = 0;
 
   switch (PAYLOAD_ENCODER) {
   case 1: // plain -> no mapping
   case 2: // packed -> no mapping
-    SendBuffer.MessagePort = port;
+    msgport = port;
     break;
   case 3: // Cayenne LPP dynamic -> all payload goes out on same port
-    SendBuffer.MessagePort = CAYENNE_LPP1;
+    msgport = CAYENNE_LPP1;
     break;
   case 4: // Cayenne LPP packed -> we need to map some paxcounter ports
-    SendBuffer.MessagePort = CAYENNE_LPP2;
-    switch (SendBuffer.MessagePort) {
+    msgport = CAYENNE_LPP2;
+    switch (msgport) {
     case COUNTERPORT:
-      SendBuffer.MessagePort = CAYENNE_LPP2;
+      msgport = CAYENNE_LPP2;
       break;
     case RCMDPORT:
-      SendBuffer.MessagePort = CAYENNE_ACTUATOR;
+      msgport = CAYENNE_ACTUATOR;
       break;
     case TIMEPORT:
-      SendBuffer.MessagePort = CAYENNE_DEVICECONFIG;
+      msgport = CAYENNE_DEVICECONFIG;
       break;
     }
     break;
   default:
-    SendBuffer.MessagePort = port;
+    msgport = port;
+  }
+
+#if (SEND_SPOOL)
+  // backlogged transports take the payload from flash spool later
+  spooled = spool_enqueue(msgport, data, size);
+  if (spooled == SEND_SPOOL_TARGETS)
+    return;
+#endif
+
+  // one shared buffer for all transports, each one releases it when done
+  MessageBuffer_t *SendBuffer =
+      sendpool.alloc(SEND_TRANSPORTS - __builtin_popcount(spooled));
+  if (SendBuffer == NULL) {
+    ESP_LOGW(TAG, "No free send buffer, payload for port %d dropped", port);
+    return;
   }
-  memcpy(SendBuffer.Message, payload.getBuffer(), SendBuffer.MessageSize);
+
+  SendBuffer->MessageSize = size;
+  SendBuffer->MessagePort = msgport;
+  memcpy(SendBuffer->Message, data, SendBuffer->MessageSize);
 
 // enqueue message in device's send queues
 #if (HAS_LORA)
-  lora_enqueuedata(&SendBuffer);
+  if (!(spooled & SPOOL_LORA))
+    lora_enqueuedata(SendBuffer);
 #endif
 #ifdef HAS_SPI
-  spi_enqueuedata(&SendBuffer);
+  if (!(spooled & SPOOL_SPI))
+    spi_enqueuedata(SendBuffer);
 #endif
 #ifdef HAS_MQTT
-  mqtt_enqueuedata(&SendBuffer);
+  if (!(spooled & SPOOL_MQTT))
+    mqtt_enqueuedata(SendBuffer);
 #endif
+#endif // SEND_TRANSPORTS
+}
 
 // write data to sdcard, if present
+static void LogPayload(uint8_t port) {
 #if (HAS_SDCARD)
   if (port == COUNTERPORT) {
 #if !(LIBPAX)   
@@ -69,9 +92,67 @@ void SendPayload(uint8_t port) {
     );
   }
 #endif
+}
+
+void SendPayload(uint8_t port) {
+
+  ESP_LOGD(TAG, "sending Payload for Port %d", port);
+
+  EnqueuePayload(port, payload.getBuffer(), payload.getSize());
+  LogPayload(port);
 
 } // SendPayload
 
+#if (PAYLOAD_AGGREGATE)
+
+// records of current send cycle, each framed as [port][length][data]
+static uint8_t aggbuf[PAYLOAD_BUFFER_SIZE];
+static uint8_t agglen = 0, aggcount = 0, aggport = 0;
+
+// send collected records, a single record goes out unframed on its own port
+static void FlushRecords(void) {
+  if (aggcount == 1)
+    EnqueuePayload(aggport, aggbuf + AGGREGATE_HEADER_SIZE,
+                   agglen - AGGREGATE_HEADER_SIZE);
+  else if (aggcount > 1) {
+    ESP_LOGD(TAG, "sending %d records aggregated on port %d", aggcount,
+             AGGREGATEPORT);
+    EnqueuePayload(AGGREGATEPORT, aggbuf, agglen);
+  }
+  agglen = aggcount = 0;
+}
+
+// append payload as record to current uplink, start a new one if it won't fit
+static void SendRecord(uint8_t port) {
+  uint8_t const size = payload.getSize();
+#if (HAS_LORA)
+  uint16_t const limit = min(lora_maxpayload(), (uint8_t)PAYLOAD_BUFFER_SIZE);
+#else
+  uint16_t const limit = PAYLOAD_BUFFER_SIZE;
+#endif
+
+  if (AGGREGATE_HEADER_SIZE + size > limit) {
+    // record alone exceeds limit, so framing it would not help
+    SendPayload(port);
+    return;
+  }
+  if (agglen + AGGREGATE_HEADER_SIZE + size > limit)
+    FlushRecords();
+
+  aggbuf[agglen++] = port;
+  aggbuf[agglen++] = size;
+  memcpy(aggbuf + agglen, payload.getBuffer(), size);
+  agglen += size;
+  aggcount++;
+  aggport = port;
+  LogPayload(port);
+}
+
+#else
+#define SendRecord(port) SendPayload(port)
+#define FlushRecords()
+#endif // PAYLOAD_AGGREGATE
+
 // interrupt triggered function to prepare payload to send
 void sendData() {
 
@@ -135,7 +216,14 @@ void sendData() {
       sds011_store(&sds_status);
       payload.addSDS(sds_status);
 #endif
-      SendPayload(COUNTERPORT);
+      SendRecord(COUNTERPORT);
+#if (SLIDING_WINDOW) && !(LIBPAX)
+      payload.reset();
+      payload.addWindow(mac_window_count(SLIDING_WINDOW_SHORT),
+                        mac_window_count(SLIDING_WINDOW_MID),
+                        mac_window_count(SLIDING_WINDOW_LONG));
+      SendRecord(WINDOWPORT);
+#endif
       // clear counter if not in cumulative counter mode
       if (cfg.countermode != 1) {
         reset_counters(); // clear macs container and reset all counters
@@ -152,7 +240,7 @@ void sendData() {
     case MEMS_DATA:
       payload.reset();
       payload.addBME(bme_status);
-      SendPayload(BMEPORT);
+      SendRecord(BMEPORT);
       break;
 #endif
 
@@ -164,7 +252,7 @@ void sendData() {
           gps_storelocation(&gps_status);
           payload.reset();
           payload.addGPS(gps_status);
-          SendPayload(GPSPORT);
+          SendRecord(GPSPORT);
         } else
           ESP_LOGD(TAG, "No valid GPS position");
       }
@@ -176,7 +264,7 @@ void sendData() {
     case SENSOR1_DATA:
       payload.reset();
       payload.addSensor(sensor_read(1));
-      SendPayload(SENSOR1PORT);
+      SendRecord(SENSOR1PORT);
 #if (COUNT_ENS)
       if (cfg.countermode != 1)
         cwa_clear();
@@ -187,14 +275,14 @@ void sendData() {
     case SENSOR2_DATA:
       payload.reset();
       payload.addSensor(sensor_read(2));
-      SendPayload(SENSOR2PORT);
+      SendRecord(SENSOR2PORT);
       break;
 #endif
 #if (HAS_SENSOR_3)
     case SENSOR3_DATA:
       payload.reset();
       payload.addSensor(sensor_read(3));
-      SendPayload(SENSOR3PORT);
+      SendRecord(SENSOR3PORT);
       break;
 #endif
 #endif
@@ -203,7 +291,7 @@ void sendData() {
     case BATT_DATA:
       payload.reset();
       payload.addVoltage(read_voltage());
-      SendPayload(BATTPORT);
+      SendRecord(BATTPORT);
       break;
 #endif
 
@@ -211,6 +299,8 @@ void sendData() {
     bitmask &= ~mask;
     mask <<= 1;
   } // while (bitmask)
+
+  FlushRecords();
 } // sendData()
 
 void flushQueues(void) {
@@ -224,6 +314,9 @@ void flushQueues(void) {
 #ifdef HAS_MQTT
   mqtt_queuereset();
 #endif
+#if (SEND_SPOOL)
+  spool_reset();
+#endif
 }
 
 bool allQueuesEmtpy(void) {
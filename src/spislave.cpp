@@ -25,84 +25,153 @@ licenses. Refer to LICENSE.txt file in repository for more details.
 #ifdef HAS_SPI
 
 #include "spislave.h"
+#include "spiframe.h"
 
 #include <driver/spi_slave.h>
-#include <sys/param.h>
-#include <rom/crc.h>
+#include <atomic>
 
 static const char TAG[] = __FILE__;
 
-#define HEADER_SIZE 4
+#ifndef SPI_FRAME_SIZE
+#define SPI_FRAME_SIZE 256
+#endif
 // SPI transaction size needs to be at least 8 bytes and dividable by 4, see
 // https://docs.espressif.com/projects/esp-idf/en/latest/api-reference/peripherals/spi_slave.html
-#define BUFFER_SIZE                                                            \
-  (MAX(8, HEADER_SIZE + PAYLOAD_BUFFER_SIZE) +                                 \
-   (PAYLOAD_BUFFER_SIZE % 4 == 0                                               \
-        ? 0                                                                    \
-        : 4 - MAX(8, HEADER_SIZE + PAYLOAD_BUFFER_SIZE) % 4))
-DMA_ATTR uint8_t txbuf[BUFFER_SIZE];
-DMA_ATTR uint8_t rxbuf[BUFFER_SIZE];
-
+#if (SPI_FRAME_SIZE % 4) || (SPI_FRAME_SIZE > 4092) ||                         \
+    (SPI_FRAME_SIZE < SPI_RECORD_HEADER + PAYLOAD_BUFFER_SIZE)
+#error SPI_FRAME_SIZE must be a multiple of 4, hold one payload and not exceed 4092
+#endif
+// one record per transaction keeps the former protocol, more need a master
+// reading all records of a frame, see README
+#ifndef SPI_FRAME_RECORDS
+#define SPI_FRAME_RECORDS 1
+#endif
+#if (SPI_FRAME_RECORDS < 1)
+#error SPI_FRAME_RECORDS must be at least 1
+#endif
+#define SPI_FRAMES 2 // one frame is clocked out while the next is prepared
+#define SPI_FRAME_MESSAGES                                                     \
+  ((SPI_FRAME_RECORDS < SPI_FRAME_SIZE / (SPI_RECORD_HEADER + 1))              \
+       ? SPI_FRAME_RECORDS                                                     \
+       : SPI_FRAME_SIZE / (SPI_RECORD_HEADER + 1))
+
+DMA_ATTR uint8_t txbuf[SPI_FRAMES][SPI_FRAME_SIZE];
+DMA_ATTR uint8_t rxbuf[SPI_FRAMES][SPI_FRAME_SIZE];
+
+typedef struct {
+  spi_slave_transaction_t transaction;
+  MessageBuffer_t *msg[SPI_FRAME_MESSAGES];
+  uint16_t count;
+} SpiFrame_t;
+
+static SpiFrame_t frames[SPI_FRAMES];
 static QueueHandle_t SPISendQueue;
+static std::atomic<uint32_t> framed(0); // messages in frames not yet sent
 
 TaskHandle_t spiTask;
 
-void spi_slave_task(void *param) {
-  while (1) {
-    MessageBuffer_t msg;
-    size_t transaction_size;
-
-    // clear rx + tx buffers
-    memset(txbuf, 0, sizeof(txbuf));
-    memset(rxbuf, 0, sizeof(rxbuf));
-
-    // fetch next or wait for payload to send from queue
-    // do not delete item from queue until it is transmitted
-    if (xQueuePeek(SPISendQueue, &msg, portMAX_DELAY) != pdTRUE) {
-      ESP_LOGE(TAG, "Premature return from xQueueReceive() with no data!");
+// fills frame with as many queued messages as fit and are allowed
+static void spi_frame_fill(uint8_t f) {
+  SpiFrame_t *frame = &frames[f];
+  MessageBuffer_t *msg;
+  uint16_t used = 0, next;
+
+  // messages in frames are limited, so a stalled master holds at most
+  // SEND_QUEUE_SIZE send buffers in frames
+  frame->count = 0;
+  while (frame->count < SPI_FRAME_MESSAGES &&
+         framed + frame->count < SEND_QUEUE_SIZE &&
+         xQueuePeek(SPISendQueue, &msg, (TickType_t)0) == pdTRUE) {
+    next = spiframe_put(txbuf[f], used, SPI_FRAME_SIZE, msg->MessagePort,
+                        msg->Message, msg->MessageSize);
+    if (!next && msg->MessageSize)
+      break; // frame full, message goes into next frame
+    xQueueReceive(SPISendQueue, &msg, (TickType_t)0);
+    if (!next) {
+      sendpool.release(msg); // empty message, nothing to send
       continue;
     }
+    frame->msg[frame->count++] = msg;
+    used = next;
+  }
+  framed += frame->count;
+
+  // set length for spi slave driver
+  frame->transaction.length = spiframe_end(txbuf[f], used, SPI_FRAME_SIZE) * 8;
+  frame->transaction.tx_buffer = txbuf[f];
+  frame->transaction.rx_buffer = rxbuf[f];
+  frame->transaction.user = frame;
+  ESP_LOGI(TAG, "Prepared SPI transaction of %d message(s), %d byte(s)",
+           frame->count, frame->transaction.length / 8);
+  ESP_LOG_BUFFER_HEXDUMP(TAG, txbuf[f], frame->transaction.length / 8,
+                         ESP_LOG_DEBUG);
+}
 
-    // fill tx buffer with data to send from queue
-    uint8_t *messageType = txbuf + 2;
-    *messageType = msg.MessagePort;
-    uint8_t *messageSize = txbuf + 3;
-    *messageSize = msg.MessageSize;
-    memcpy(txbuf + HEADER_SIZE, &msg.Message, msg.MessageSize);
-    // calculate crc16 checksum over txbuf and insert checksum at pos 0+1 of
-    // txbuf
-    uint16_t *crc = (uint16_t *)txbuf;
-    *crc = crc16_be(0, messageType, msg.MessageSize + HEADER_SIZE - 2);
-
-    // set length for spi slave driver
-    transaction_size = HEADER_SIZE + msg.MessageSize;
-    // SPI transaction size needs to be at least 8 bytes and dividable by 4, see
-    // https://docs.espressif.com/projects/esp-idf/en/latest/api-reference/peripherals/spi_slave.html
-    if (transaction_size % 4 != 0) {
-      transaction_size += (4 - transaction_size % 4);
+// releases messages of a sent frame and runs commands sent by master
+static void spi_frame_done(spi_slave_transaction_t *transaction) {
+  SpiFrame_t *frame = (SpiFrame_t *)transaction->user;
+  uint16_t const len = transaction->trans_len / 8;
+
+  ESP_LOGI(TAG, "Transaction finished with size %zu bits",
+           transaction->trans_len);
+  ESP_LOG_BUFFER_HEXDUMP(TAG, transaction->rx_buffer, len, ESP_LOG_DEBUG);
+
+  for (uint16_t i = 0; i < frame->count; i++)
+    sendpool.release(frame->msg[i]);
+  framed -= frame->count;
+  frame->count = 0;
+
+  // check if command was received, then call interpreter with command payload
+#if (SPI_FRAME_RECORDS > 1)
+  if (spiframe_parse((const uint8_t *)transaction->rx_buffer, len,
+                     [](uint8_t port, const uint8_t *payload, uint8_t size) {
+                       if (port == RCMDPORT)
+                         rcommand(payload, size);
+                     }) < 0)
+    ESP_LOGD(TAG, "No valid record received from SPI master");
+#else
+  // former protocol, command is taken unchecked from rest of transaction
+  const uint8_t *rx = (const uint8_t *)transaction->rx_buffer;
+  if (len > SPI_RECORD_HEADER && rx[2] == RCMDPORT)
+    rcommand(rx + SPI_RECORD_HEADER, len - SPI_RECORD_HEADER);
+#endif
+}
+
+// called from ISR when master finished a transaction
+static void IRAM_ATTR spi_post_trans(spi_slave_transaction_t *transaction) {
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(spiTask, &xHigherPriorityTaskWoken);
+  if (xHigherPriorityTaskWoken)
+    portYIELD_FROM_ISR();
+}
+
+void spi_slave_task(void *param) {
+  spi_slave_transaction_t *transaction;
+  uint8_t next = 0, queued = 0;
+
+  while (1) {
+    // collect frames clocked out by master
+    while (queued && spi_slave_get_trans_result(HSPI_HOST, &transaction,
+                                                (TickType_t)0) == ESP_OK) {
+      spi_frame_done(transaction);
+      queued--;
     }
 
-    // prepare spi transaction
-    spi_slave_transaction_t spi_transaction = {0};
-    spi_transaction.length = transaction_size * 8;
-    spi_transaction.tx_buffer = txbuf;
-    spi_transaction.rx_buffer = rxbuf;
-
-    // wait until spi master clocks out the data, and read results in rx buffer
-    ESP_LOGI(TAG, "Prepared SPI transaction for %zu byte(s)", transaction_size);
-    ESP_LOG_BUFFER_HEXDUMP(TAG, txbuf, transaction_size, ESP_LOG_DEBUG);
-    spi_slave_transmit(HSPI_HOST, &spi_transaction, portMAX_DELAY);
-    ESP_LOG_BUFFER_HEXDUMP(TAG, rxbuf, transaction_size, ESP_LOG_DEBUG);
-    ESP_LOGI(TAG, "Transaction finished with size %zu bits",
-             spi_transaction.trans_len);
-
-    // delete sent item from queue
-    xQueueReceive(SPISendQueue, &msg, (TickType_t)0);
+    // prepare next frame while the current one waits for the master
+    if (queued < SPI_FRAMES && uxQueueMessagesWaiting(SPISendQueue)) {
+      spi_frame_fill(next);
+      if (frames[next].count) {
+        spi_slave_queue_trans(HSPI_HOST, &frames[next].transaction,
+                              portMAX_DELAY);
+        next = (next + 1) % SPI_FRAMES;
+        queued++;
+        continue;
+      }
+      // nothing framed, all messages allowed in frames wait for the master
+    }
 
-    // check if command was received, then call interpreter with command payload
-    if ((spi_transaction.trans_len) && ((rxbuf[2]) == RCMDPORT)) {
-      rcommand(rxbuf + HEADER_SIZE, spi_transaction.trans_len - HEADER_SIZE);
-    };
+    // wait for new message or finished transaction
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   }
 }
 
@@ -110,28 +179,28 @@ void spi_deinit(void) { vTaskDelete(spiTask); }
 
 esp_err_t spi_init(void) {
   _ASSERT(SEND_QUEUE_SIZE > 0);
-  SPISendQueue = xQueueCreate(SEND_QUEUE_SIZE, sizeof(MessageBuffer_t));
+  SPISendQueue = xQueueCreate(SEND_QUEUE_SIZE, sizeof(MessageBuffer_t *));
   if (SPISendQueue == 0) {
     ESP_LOGE(TAG, "Could not create SPI send queue. Aborting.");
     return ESP_FAIL;
   }
   ESP_LOGI(TAG, "SPI send queue created, size %d Bytes",
-           SEND_QUEUE_SIZE * PAYLOAD_BUFFER_SIZE);
+           SEND_QUEUE_SIZE * sizeof(MessageBuffer_t *));
 
   spi_bus_config_t spi_bus_cfg = {.mosi_io_num = SPI_MOSI,
                                   .miso_io_num = SPI_MISO,
                                   .sclk_io_num = SPI_SCLK,
                                   .quadwp_io_num = -1,
                                   .quadhd_io_num = -1,
-                                  .max_transfer_sz = 0,
+                                  .max_transfer_sz = SPI_FRAME_SIZE,
                                   .flags = 0};
 
   spi_slave_interface_config_t spi_slv_cfg = {.spics_io_num = SPI_CS,
                                               .flags = 0,
-                                              .queue_size = 1,
+                                              .queue_size = SPI_FRAMES,
                                               .mode = 0,
                                               .post_setup_cb = NULL,
-                                              .post_trans_cb = NULL};
+                                              .post_trans_cb = spi_post_trans};
 
   // Enable pull-ups on SPI lines so we don't detect rogue pulses when no master
   // is connected
@@ -154,12 +223,29 @@ esp_err_t spi_init(void) {
 
 void spi_enqueuedata(MessageBuffer_t *message) {
   // enqueue message in SPI send queue
-  if (xQueueSendToBack(SPISendQueue, (void *)message, (TickType_t)0) != pdTRUE)
+  if (xQueueSendToBack(SPISendQueue, (void *)&message, (TickType_t)0) !=
+      pdTRUE) {
+    sendpool.release(message);
     ESP_LOGW(TAG, "SPI sendqueue is full");
+  } else if (spiTask)
+    xTaskNotifyGive(spiTask); // wake up spi loop
 }
 
-void spi_queuereset(void) { xQueueReset(SPISendQueue); }
+void spi_queuereset(void) {
+  MessageBuffer_t *message;
+  // give back our references to all waiting messages
+  while (xQueueReceive(SPISendQueue, &message, (TickType_t)0) == pdTRUE)
+    sendpool.release(message);
+}
 
-uint32_t spi_queuewaiting(void) { return uxQueueMessagesWaiting(SPISendQueue); }
+// messages waiting in queue or in frames not yet clocked out by master
+uint32_t spi_queuewaiting(void) {
+  return uxQueueMessagesWaiting(SPISendQueue) + framed;
+}
+
+// queue has room, as long as master keeps polling
+bool spi_queueready(uint8_t port) {
+  return uxQueueSpacesAvailable(SPISendQueue) > 0;
+}
 
 #endif // HAS_SPI
\ No newline at end of file
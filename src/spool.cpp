@@ -0,0 +1,168 @@
+// Basic Config
+#include "senddata.h"
+
+#if (SEND_SPOOL)
+
+static const char TAG[] = __FILE__;
+
+// spool log on the data partition of type spiffs
+class SpoolFlash {
+
+public:
+  const esp_partition_t *part = NULL;
+
+  bool read(uint32_t addr, void *dst, uint32_t len) {
+    return esp_partition_read(part, addr, dst, len) == ESP_OK;
+  }
+  bool write(uint32_t addr, const void *src, uint32_t len) {
+    return esp_partition_write(part, addr, src, len) == ESP_OK;
+  }
+  bool erase(uint32_t addr) {
+    return esp_partition_erase_range(part, addr, SPOOL_SEGMENT_SIZE) == ESP_OK;
+  }
+  uint32_t size(void) const { return part ? part->size : 0; }
+};
+
+typedef struct {
+  uint8_t target;
+  bool (*ready)(uint8_t port);
+  void (*enqueue)(MessageBuffer_t *message);
+} SpoolTransport_t;
+
+static const SpoolTransport_t SpoolTransports[] = {
+#if (HAS_LORA)
+    {SPOOL_LORA, lora_queueready, lora_enqueuedata},
+#endif
+#ifdef HAS_SPI
+    {SPOOL_SPI, spi_queueready, spi_enqueuedata},
+#endif
+#ifdef HAS_MQTT
+    {SPOOL_MQTT, mqtt_queueready, mqtt_enqueuedata},
+#endif
+};
+
+static SpoolFlash spoolFlash;
+static SpoolLog<SpoolFlash, SPOOL_SEGMENT_SIZE, SPOOL_MAX_SEGMENTS>
+    spoolLog(spoolFlash);
+static SemaphoreHandle_t SpoolLock = NULL;
+static TaskHandle_t spoolTask = NULL;
+static uint32_t spoolDropped = 0; // overflows already reported
+
+// send buffers left to live payloads while draining the spool
+static bool spool_headroom(void) {
+  return sendpool.capacity() - sendpool.in_use() > SPOOL_POOL_RESERVE;
+}
+
+// hands spooled payloads over to each transport, as fast as it takes them,
+// and erases flash for the next appends meanwhile
+static void spool_task(void *pvParameters) {
+  MessageBuffer_t *message;
+  const uint8_t *data;
+  uint8_t port, size;
+  bool moved;
+
+  while (1) {
+    moved = false;
+    xSemaphoreTake(SpoolLock, portMAX_DELAY);
+    for (const SpoolTransport_t &t : SpoolTransports)
+      while (spool_headroom() && spoolLog.peek(t.target, port, data, size) &&
+             t.ready(port)) {
+        message = sendpool.alloc(1);
+        if (message == NULL)
+          break;
+        message->MessagePort = port;
+        message->MessageSize = size;
+        memcpy(message->Message, data, size);
+        t.enqueue(message);
+        spoolLog.done(t.target);
+        moved = true;
+      }
+    // sector erase is done here, not by appends in the sender's context
+    spoolLog.prepare();
+    xSemaphoreGive(SpoolLock);
+    vTaskDelay(moved ? 1 : pdMS_TO_TICKS(SPOOL_DRAIN_MS));
+  }
+}
+
+esp_err_t spool_init(void) {
+  spoolFlash.part = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+  if (spoolFlash.part == NULL) {
+    ESP_LOGE(TAG, "No spiffs partition for spool found");
+    return ESP_FAIL;
+  }
+  if (!spoolLog.mount()) {
+    ESP_LOGE(TAG, "Could not mount spool. Aborting.");
+    return ESP_FAIL;
+  }
+  SpoolLock = xSemaphoreCreateMutex(); // spool is in use from here
+  if (SpoolLock == NULL) {
+    ESP_LOGE(TAG, "Could not create spool lock. Aborting.");
+    return ESP_FAIL;
+  }
+  ESP_LOGI(TAG, "Spool mounted, %u of %u segments in use, %u message(s) "
+           "waiting",
+           spoolLog.used(), spoolLog.capacity(), spool_waiting());
+
+  xTaskCreatePinnedToCore(spool_task, "spool", 3072, (void *)NULL, 1,
+                          &spoolTask, 1);
+  return ESP_OK;
+}
+
+// high priority ports (alarm, button, time sync) are of no use after the
+// backlog, they go straight to the send queues
+static bool spool_bypass(uint8_t port) {
+  static const uint8_t high[] = {SEND_PRIO_HIGH_PORTS};
+  for (uint8_t p : high)
+    if (p == port)
+      return true;
+  return false;
+}
+
+// writes payload to spool for all transports which can not take it now, or
+// still have spooled payloads, which must go first. Returns the transports
+// spooled for, those get no copy in their send queue.
+uint8_t spool_enqueue(uint8_t port, const uint8_t *data, uint8_t size) {
+  uint8_t targets = 0, backlog;
+
+  if (SpoolLock == NULL || spool_bypass(port))
+    return 0; // not mounted, or urgent
+  xSemaphoreTake(SpoolLock, portMAX_DELAY);
+  backlog = spoolLog.backlog();
+  for (const SpoolTransport_t &t : SpoolTransports)
+    if ((backlog & t.target) || !t.ready(port))
+      targets |= t.target;
+  if (targets && !spoolLog.append(targets, port, data, size)) {
+    ESP_LOGW(TAG, "Could not write spool, message for port %d queued", port);
+    targets = 0;
+  }
+  if (spoolLog.overflows() != spoolDropped) {
+    ESP_LOGW(TAG, "Spool is full, %u oldest message(s) dropped",
+             spoolLog.overflows() - spoolDropped);
+    spoolDropped = spoolLog.overflows();
+  }
+  xSemaphoreGive(SpoolLock);
+  return targets;
+}
+
+// spooled messages not yet handed over, counted once per transport
+uint32_t spool_waiting(void) {
+  uint32_t n = 0;
+  if (SpoolLock == NULL)
+    return 0;
+  xSemaphoreTake(SpoolLock, portMAX_DELAY);
+  for (const SpoolTransport_t &t : SpoolTransports)
+    n += spoolLog.waiting(t.target);
+  xSemaphoreGive(SpoolLock);
+  return n;
+}
+
+void spool_reset(void) {
+  if (SpoolLock == NULL)
+    return;
+  xSemaphoreTake(SpoolLock, portMAX_DELAY);
+  spoolLog.reset();
+  xSemaphoreGive(SpoolLock);
+}
+
+#endif // SEND_SPOOL
@@ -0,0 +1,211 @@
+// crowdgen.cpp
+// Host tool generating synthetic MAC traces of a crowd, for load testing the
+// counting core with tools/replay.
+//
+// Models N devices arriving uniformly over the trace duration and staying an
+// exponentially distributed dwell time. Each device is a wifi phone sending
+// probe request bursts, or a BLE advertiser. Both use random, locally
+// administered MACs which are rotated periodically. RSSI follows a log
+// distance path loss model with the device placed at random in a circle
+// around the paxcounter, plus gaussian shadowing per frame.
+//
+// build: g++ -O2 -std=c++11 -o crowdgen crowdgen.cpp
+// usage: crowdgen [options] > trace.csv
+//
+//   -n  number of devices [1000]
+//   -t  trace duration [minutes, 60]
+//   -w  mean dwell time of a device [minutes, 20]
+//   -b  share of BLE advertisers [percent, 30]
+//   -p  mean interval between wifi probe bursts [seconds, 30]
+//   -a  BLE advertising interval [milliseconds, 1000]
+//   -m  MAC rotation interval [minutes, 15]
+//   -r  radius of the crowd around the device [meters, 50]
+//   -s  random seed [1]
+//
+// Trace goes to stdout in the format read by tools/replay, a summary with
+// peak frame rates goes to stderr. Feed the trace to replay -p to see frames
+// lost by the MAC rings for a given MAC_QUEUE_SIZE and processing time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <queue>
+#include <random>
+#include <vector>
+
+typedef struct {
+  uint32_t arrive, leave; // [ms]
+  uint32_t rotated;       // [ms] time of last MAC rotation
+  uint8_t mac[6];
+  bool ble;
+  float rssi;             // [dBm] mean at device position
+  uint8_t burst;          // frames left in current probe burst
+} Device_t;
+
+typedef struct {
+  uint32_t ms;
+  uint32_t device;
+} Event_t;
+
+struct Later {
+  bool operator()(const Event_t &a, const Event_t &b) const {
+    return a.ms > b.ms;
+  }
+};
+
+typedef struct {
+  uint32_t devices, minutes, dwell, share_ble, probe, adv, rotate, radius;
+  uint32_t seed;
+} Options_t;
+
+static std::mt19937 rng;
+
+static double uniform(double lo, double hi) {
+  return std::uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+static double exponential(double mean) {
+  return std::exponential_distribution<double>(1.0 / mean)(rng);
+}
+
+// random, locally administered unicast MAC, as used by phones for privacy
+static void random_mac(uint8_t *mac) {
+  for (int i = 0; i < 6; i++)
+    mac[i] = rng();
+  mac[0] = (mac[0] & 0xfc) | 0x02;
+}
+
+// log distance path loss, -45 dBm at 1 m, exponent 2.7 for crowded places
+static float path_rssi(double meters) {
+  return -45.0f - 27.0f * log10f(meters < 1.0 ? 1.0f : (float)meters);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: crowdgen [-n devices] [-t minutes] [-w dwell] "
+                  "[-b ble%%] [-p probe] [-a adv] [-m rotate] [-r radius] "
+                  "[-s seed]\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+
+  Options_t opt = {1000, 60, 20, 30, 30, 1000, 15, 50, 1};
+  int c;
+
+  while ((c = getopt(argc, argv, "n:t:w:b:p:a:m:r:s:")) != -1) {
+    const uint32_t v = strtoul(optarg, NULL, 10);
+    switch (c) {
+    case 'n':
+      opt.devices = v;
+      break;
+    case 't':
+      opt.minutes = v;
+      break;
+    case 'w':
+      opt.dwell = v;
+      break;
+    case 'b':
+      opt.share_ble = v;
+      break;
+    case 'p':
+      opt.probe = v;
+      break;
+    case 'a':
+      opt.adv = v;
+      break;
+    case 'm':
+      opt.rotate = v;
+      break;
+    case 'r':
+      opt.radius = v;
+      break;
+    case 's':
+      opt.seed = v;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (!opt.devices || !opt.minutes || !opt.probe || !opt.adv || !opt.radius ||
+      opt.share_ble > 100)
+    usage();
+
+  rng.seed(opt.seed);
+  const uint32_t end = opt.minutes * 60000UL;
+  std::vector<Device_t> devices(opt.devices);
+  std::priority_queue<Event_t, std::vector<Event_t>, Later> events;
+  std::normal_distribution<float> shadowing(0.0f, 4.0f);
+
+  for (uint32_t i = 0; i < opt.devices; i++) {
+    Device_t &d = devices[i];
+    d.arrive = uniform(0, end);
+    d.leave = d.arrive + exponential(opt.dwell * 60000.0);
+    d.rotated = d.arrive;
+    d.ble = uniform(0, 100) < opt.share_ble;
+    // uniform position in circle, at least 1 m away
+    d.rssi = path_rssi(opt.radius * sqrt(uniform(0, 1)));
+    d.burst = 0;
+    random_mac(d.mac);
+    events.push({d.arrive, i});
+  }
+
+  printf("# crowdgen -n %u -t %u -w %u -b %u -p %u -a %u -m %u -r %u -s %u\n",
+         opt.devices, opt.minutes, opt.dwell, opt.share_ble, opt.probe,
+         opt.adv, opt.rotate, opt.radius, opt.seed);
+
+  // frame rates per 100 ms slot, for sizing the MAC processing rings
+  uint32_t slot = 0, slot_frames = 0, peak = 0, frames = 0, macs = 0;
+
+  while (!events.empty()) {
+    const Event_t e = events.top();
+    events.pop();
+    Device_t &d = devices[e.device];
+    if (e.ms >= end || e.ms >= d.leave)
+      continue;
+
+    if (opt.rotate && e.ms - d.rotated >= opt.rotate * 60000UL) {
+      random_mac(d.mac);
+      d.rotated = e.ms;
+      macs++;
+    }
+
+    float rssi = d.rssi + shadowing(rng);
+    if (rssi > -20.0f)
+      rssi = -20.0f;
+    else if (rssi < -127.0f)
+      rssi = -127.0f;
+    printf("%u,%c,%d,%02x:%02x:%02x:%02x:%02x:%02x\n", e.ms, d.ble ? 'b' : 'w',
+           (int)lroundf(rssi), d.mac[0], d.mac[1], d.mac[2], d.mac[3],
+           d.mac[4], d.mac[5]);
+    frames++;
+
+    if (e.ms / 100 != slot) {
+      slot = e.ms / 100;
+      slot_frames = 0;
+    }
+    if (++slot_frames > peak)
+      peak = slot_frames;
+
+    uint32_t next;
+    if (d.ble) {
+      // advertising interval plus random delay of 0..10 ms, as by BLE spec
+      next = opt.adv + (uint32_t)uniform(0, 10);
+    } else if (d.burst) {
+      d.burst--;
+      next = 10 + (uint32_t)uniform(0, 20); // next frame of burst
+    } else {
+      d.burst = (uint8_t)uniform(1, 4); // probes on several channels
+      next = (uint32_t)exponential(opt.probe * 1000.0);
+    }
+    events.push({e.ms + next, e.device});
+  }
+
+  fprintf(stderr, "devices %u, MACs %u, frames %u, mean %.1f frames/s, "
+                  "peak %u frames per 100 ms\n",
+          opt.devices, opt.devices + macs, frames,
+          frames / (opt.minutes * 60.0), peak);
+
+  return 0;
+}
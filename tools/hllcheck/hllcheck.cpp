@@ -0,0 +1,82 @@
+// hllcheck.cpp
+// Host check of the HyperLogLog estimator, see include/hyperloglog.h.
+//
+// Feeds n distinct random MACs, hashed with keyhash<4>() as mac_analyze()
+// does, into sketches of some precisions and compares the estimates with n.
+// Reports bias and relative standard error over a number of trials against
+// the expected 1.04 / sqrt(2^P), and ns per hash and add(). Also checks that
+// merging two sketches of disjoint halves estimates the same as one sketch of
+// all. Exits with 1 if an error exceeds 1.5 times the expected one.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o hllcheck hllcheck.cpp
+// usage: hllcheck [trials]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+
+#include "keyhash.h"
+#include "hyperloglog.h"
+
+typedef std::chrono::steady_clock Clock;
+
+template <uint8_t P> static bool check(int trials) {
+  static const uint32_t sizes[] = {100, 1000, 10000, 100000, 1000000};
+  double const expect = 1.04 / sqrt((double)(1UL << P));
+  bool ok = true;
+
+  for (uint32_t n : sizes) {
+    std::mt19937 rng(n + P);
+    double sum = 0, sqsum = 0, nanos = 0;
+    long merged = 0;
+
+    for (int t = 0; t < trials; t++) {
+      HyperLogLog<P> all, half[2];
+      uint32_t const salt = rng();
+      Clock::time_point t0 = Clock::now();
+      for (uint32_t i = 0; i < n; i++) {
+        uint32_t const mac = (rng() & 0xfff00000) | i; // distinct
+        all.add(keyhash<4>(&mac, salt));
+      }
+      nanos += std::chrono::duration<double, std::nano>(Clock::now() - t0)
+                   .count();
+      double const e = (double)all.estimate() / n - 1.0;
+      sum += e;
+      sqsum += e * e;
+
+      if (n > 100000)
+        continue; // merge check is slow for large sets
+      for (uint32_t i = 0; i < n; i++)
+        half[i % 2].add(keyhash<4>(&i, salt));
+      HyperLogLog<P> one;
+      for (uint32_t i = 0; i < n; i++)
+        one.add(keyhash<4>(&i, salt));
+      half[0].merge(half[1]);
+      if (half[0].estimate() != one.estimate())
+        merged++;
+    }
+
+    double const bias = sum / trials,
+                 rse = sqrt(sqsum / trials - bias * bias);
+    bool const good = rse < 1.5 * expect && fabs(bias) < 1.5 * expect &&
+                      !merged;
+    printf("P=%-2u %5u bytes  n=%-7u  bias %+6.2f%%  error %5.2f%% "
+           "(expected %4.2f%%)  %5.1f ns/add  %s\n",
+           P, HyperLogLog<P>::registers(), n, 100 * bias, 100 * rse,
+           100 * expect, nanos / trials / n, good ? "ok" : "FAILED");
+    ok = ok && good;
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  int const trials = argc > 1 ? atoi(argv[1]) : 100;
+  bool ok = true;
+
+  ok = check<8>(trials) && ok;
+  ok = check<11>(trials) && ok; // HLL_PRECISION default
+  ok = check<14>(trials) && ok;
+  return ok ? 0 : 1;
+}
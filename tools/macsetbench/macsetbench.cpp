@@ -0,0 +1,115 @@
+// macsetbench.cpp
+// Host microbenchmark of the MAC container, see include/macset.h.
+//
+// Inserts n distinct random 16 bit hashed MACs, then looks up n keys of which
+// half are present, once into MacSet<16> as used by mac_analyze(), once into
+// std::set<uint16_t> as used before. Reports ns per insert and per lookup and
+// the heap taken by the std::set nodes. Both containers must agree on all
+// results, the tool exits with 1 otherwise.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o macsetbench macsetbench.cpp
+// usage: macsetbench [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "macset.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static size_t heap_bytes = 0; // allocated by CountingAllocator
+
+// std::allocator, counting bytes like Mallocator would take from the heap
+template <class T> struct CountingAllocator {
+  typedef T value_type;
+  CountingAllocator() noexcept {}
+  template <class U> CountingAllocator(const CountingAllocator<U> &) noexcept {}
+  template <class U> bool operator==(const CountingAllocator<U> &) const {
+    return true;
+  }
+  template <class U> bool operator!=(const CountingAllocator<U> &) const {
+    return false;
+  }
+  T *allocate(size_t n) const {
+    heap_bytes += n * sizeof(T);
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n) const noexcept {
+    heap_bytes -= n * sizeof(T);
+    ::operator delete(p);
+  }
+};
+
+typedef std::set<uint16_t, std::less<uint16_t>, CountingAllocator<uint16_t>>
+    StdSet_t;
+
+static double ns(Clock::duration d, long ops) {
+  return std::chrono::duration<double, std::nano>(d).count() / ops;
+}
+
+static bool bench(uint32_t n, int rounds) {
+  static MacSet<16, 0> bitmap;
+  std::mt19937 rng(n);
+  std::vector<uint16_t> keys(0x10000), probes(n);
+  long hits[2] = {0, 0}, added[2] = {0, 0};
+  Clock::duration t[4] = {};
+  size_t nodes = 0;
+
+  // first n of a random permutation are inserted, probes are half of them
+  // and half keys never inserted
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), rng);
+  for (uint32_t i = 0; i < n; i++)
+    probes[i] = i % 2 ? keys[rng() % n] : keys[n + rng() % (0x10000 - n)];
+
+  for (int r = 0; r < rounds; r++) {
+    StdSet_t set;
+    bitmap.clear();
+    Clock::time_point t0 = Clock::now();
+    for (uint32_t i = 0; i < n; i++)
+      added[0] += bitmap.insert(keys[i]);
+    Clock::time_point t1 = Clock::now();
+    for (uint32_t i = 0; i < n; i++)
+      hits[0] += bitmap.contains(probes[i]);
+    Clock::time_point t2 = Clock::now();
+    for (uint32_t i = 0; i < n; i++)
+      added[1] += set.insert(keys[i]).second;
+    Clock::time_point t3 = Clock::now();
+    for (uint32_t i = 0; i < n; i++)
+      hits[1] += set.count(probes[i]);
+    Clock::time_point t4 = Clock::now();
+    nodes = heap_bytes;
+    t[0] += t1 - t0;
+    t[1] += t2 - t1;
+    t[2] += t3 - t2;
+    t[3] += t4 - t3;
+  }
+
+  long const ops = (long)n * rounds;
+  bool const ok = added[0] == added[1] && hits[0] == hits[1] &&
+                  bitmap.size() == n && added[0] == ops;
+  printf("%6u  %8.1f %8.1f %8zu   %8.1f %8.1f %8zu  %s\n", n, ns(t[0], ops),
+         ns(t[1], ops), sizeof(bitmap), ns(t[2], ops), ns(t[3], ops), nodes,
+         ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  int const rounds = argc > 1 ? atoi(argv[1]) : 20;
+  bool ok = true;
+
+  printf("                  MacSet<16>                   std::set\n");
+  printf("     n    insert   lookup    bytes     insert   lookup  "
+         "  bytes\n");
+  for (uint32_t n : {1000, 10000, 60000})
+    ok = bench(n, rounds) && ok;
+  printf("(ns per operation, bytes of container on host, without malloc "
+         "overhead)\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+// macsetsim.cpp
+// Host simulation of count accuracy of the MAC container by hash width, see
+// include/macset.h.
+//
+// Inserts the keyhashed MACs of n distinct random devices into MacSet<16>,
+// MacSet<24> and MacSet<32> of MAC_SET_SLOTS slots, as mac_analyze() does in
+// one send cycle, and reports the mean count error against n. Undercount
+// comes from fingerprint collisions, and for 24 / 32 bit from new MACs
+// rejected once the table holds 3/4 of MAC_SET_SLOTS, which is sized for
+// MAC_SET_CROWD devices as in globals.h.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o macsetsim macsetsim.cpp
+//        add -DMAC_SET_CROWD=45000 to simulate other table sizes
+// usage: macsetsim [trials]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+
+#include "keyhash.h"
+#include "macset.h"
+
+// defaults as in globals.h, override with -D at build
+#ifndef MAC_SET_CROWD
+#define MAC_SET_CROWD 5000
+#endif
+#ifndef MAC_SET_SLOTS
+#define MAC_SET_SLOTS macset_slots(MAC_SET_CROWD)
+#endif
+
+// mean count error in percent of n devices
+template <uint8_t BITS> static double error(uint32_t n, int trials) {
+  static MacSet<BITS, MAC_SET_SLOTS> macs;
+  std::mt19937 rng(n);
+  double sum = 0;
+
+  for (int t = 0; t < trials; t++) {
+    uint32_t const salt = rng();
+    macs.clear();
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t const tail = (rng() & 0xfff00000) | i; // distinct
+      macs.insert(
+          (typename MacSet<BITS, MAC_SET_SLOTS>::key_t)keyhash<4>(&tail, salt));
+    }
+    sum += 100.0 * ((double)macs.size() - n) / n;
+  }
+  return sum / trials;
+}
+
+int main(int argc, char **argv) {
+  int const trials = argc > 1 ? atoi(argv[1]) : 20;
+
+  printf("MAC_SET_CROWD %u, MAC_SET_SLOTS %u, 24 / 32 bit count at most %u "
+         "per cycle\n\n",
+         MAC_SET_CROWD, MAC_SET_SLOTS, MAC_SET_SLOTS / 4 * 3);
+  printf("devices    16 bit    24 bit    32 bit\n");
+  for (uint32_t n : {1000, 5000, 20000, 45000})
+    printf("%7u  %+7.2f%%  %+7.2f%%  %+7.2f%%\n", n, error<16>(n, trials),
+           error<24>(n, trials), error<32>(n, trials));
+  return 0;
+}
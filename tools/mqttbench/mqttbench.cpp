@@ -0,0 +1,370 @@
+// mqttbench.cpp
+// Host benchmark of the MQTT outbox against a loopback broker stand-in.
+//
+// A broker thread on 127.0.0.1 takes MQTT PUBLISH packets, answers QoS 1
+// publishes with PUBACK after an optional delay emulating the network round
+// trip, and splits and decodes the batches. The client side moves messages
+// through the same outbox and batching as mqtt_client_task(), publishing as
+// arduino-mqtt does: QoS 0 writes the packet, QoS 1 blocks until PUBACK.
+// Messages per second and bytes on the wire are measured with one message per
+// publish as before, and with batches, in wire format base64, raw or json.
+// The broker checks that all messages arrive in order of their port and
+// unchanged, the tool exits with 1 otherwise.
+//
+// build: g++ -O2 -std=c++11 -pthread -I../../include -o mqttbench mqttbench.cpp
+// usage: mqttbench [-n messages] [-d ackdelay_us] [-b batchsize]
+//                  [-f base64|raw|json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PAYLOAD_BUFFER_SIZE 51 // as in paxcounter_orig.conf
+#define SEND_QUEUE_SIZE 10
+#define MQTT_BATCH_MAX 32
+#define MQTT_OUTTOPIC "paxout"
+
+// ports as in paxcounter_orig.conf
+#define COUNTERPORT 1
+#define STATUSPORT 2
+#define GPSPORT 4
+#define BUTTONPORT 5
+#define BEACONPORT 6
+#define BATTPORT 8
+#define TIMEPORT 9
+#define SENSOR1PORT 10
+#define WINDOWPORT 13
+
+typedef struct {
+  uint8_t MessageSize;
+  uint8_t MessagePort;
+  uint8_t Message[PAYLOAD_BUFFER_SIZE];
+} MessageBuffer_t;
+
+#include "mqttoutbox.h"
+
+typedef MqttOutbox<MessageBuffer_t, SEND_QUEUE_SIZE> MqttOutbox_t;
+
+static bool readn(int fd, uint8_t *p, size_t n) {
+  while (n) {
+    ssize_t r = read(fd, p, n);
+    if (r <= 0)
+      return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+static bool writen(int fd, const uint8_t *p, size_t n) {
+  while (n) {
+    ssize_t r = write(fd, p, n);
+    if (r <= 0)
+      return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+/* ---------------- broker stand-in ---------- */
+
+static uint8_t Format = MQTT_FORMAT_BASE64;
+static bool Batched = false; // publishes may carry more than one message
+
+static uint16_t encode(const MessageBuffer_t *msg, bool first, char *out,
+                       uint16_t size) {
+  return mqtt_encode<true>(msg, Format, first, Batched, out, size);
+}
+
+struct Broker {
+  int listenfd;
+  long ackdelay_us;
+  long bytes = 0;
+  // expected messages per topic, in order
+  std::map<std::string, std::deque<std::vector<uint8_t>>> expect;
+  std::atomic<long> received{0}, errors{0};
+
+  // compares message with next one expected on topic
+  void check(const std::string &topic, const uint8_t *msg, int n) {
+    auto &q = expect[topic];
+    if (!msg || q.empty() || q.front() != std::vector<uint8_t>(msg, msg + n))
+      errors++;
+    if (!q.empty())
+      q.pop_front();
+    received++;
+  }
+
+  void check_json(const std::string &topic, const char *json, size_t n) {
+    auto &q = expect[topic];
+    char ref[2][512];
+    uint16_t len[2] = {0, 0};
+    if (!q.empty()) {
+      MessageBuffer_t m;
+      m.MessagePort = atoi(topic.c_str() + strlen(MQTT_OUTTOPIC "/"));
+      m.MessageSize = q.front().size();
+      memcpy(m.Message, q.front().data(), m.MessageSize);
+      len[0] = mqtt_encode<true>(&m, Format, true, Batched, ref[0],
+                                 sizeof(ref[0]));
+      len[1] = mqtt_encode<true>(&m, Format, true, Batched, ref[1],
+                                 sizeof(ref[1]), false);
+      q.pop_front();
+    }
+    if (!(n == len[0] && !memcmp(json, ref[0], n)) &&
+        !(n == len[1] && !memcmp(json, ref[1], n)))
+      errors++;
+    received++;
+  }
+
+  void serve(void) {
+    int fd = accept(listenfd, NULL, NULL);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::vector<uint8_t> body;
+    uint8_t header;
+
+    while (readn(fd, &header, 1)) {
+      uint32_t len = 0, shift = 0;
+      uint8_t b;
+      do {
+        if (!readn(fd, &b, 1))
+          return;
+        len |= (b & 0x7f) << shift;
+        shift += 7;
+      } while (b & 0x80);
+      body.resize(len);
+      if (!readn(fd, body.data(), len))
+        break;
+      if ((header >> 4) == 14) // DISCONNECT
+        break;
+      if ((header >> 4) != 3) { // not PUBLISH
+        errors++;
+        continue;
+      }
+
+      uint8_t const qos = (header >> 1) & 3;
+      uint16_t const tlen = body[0] << 8 | body[1];
+      std::string topic((const char *)body.data() + 2, tlen);
+      size_t i = 2 + tlen + (qos ? 2 : 0);
+      if (qos) {
+        if (ackdelay_us)
+          std::this_thread::sleep_for(std::chrono::microseconds(ackdelay_us));
+        uint8_t ack[4] = {0x40, 2, body[2 + tlen], body[3 + tlen]};
+        writen(fd, ack, 4);
+      }
+
+      bytes += len - i;
+      if (Format == MQTT_FORMAT_RAW && !Batched)
+        check(topic, body.data() + i, len - i);
+      else if (Format == MQTT_FORMAT_RAW)
+        while (i < len) {
+          uint8_t const n = body[i];
+          check(topic, i + 1 + n <= len ? body.data() + i + 1 : NULL, n);
+          i += 1 + n;
+        }
+      else
+        // split batch, one message per line
+        while (i <= len) {
+          size_t end = i;
+          while (end < len && body[end] != MQTT_BATCH_SEPARATOR)
+            end++;
+          if (Format == MQTT_FORMAT_JSON)
+            check_json(topic, (const char *)body.data() + i, end - i);
+          else {
+            uint8_t msg[PAYLOAD_BUFFER_SIZE];
+            int n = base64_get(msg, sizeof(msg),
+                               (const char *)body.data() + i, end - i);
+            check(topic, n < 0 ? NULL : msg, n);
+          }
+          i = end + 1;
+        }
+    }
+    close(fd);
+  }
+};
+
+/* ---------------- client, as mqtt_client_task() ---------- */
+
+struct Client {
+  int fd;
+  uint16_t packetid = 0;
+  std::vector<uint8_t> packet;
+
+  // as MQTTClient::publish() of arduino-mqtt
+  bool publish(const char *topic, const char *payload, uint16_t len,
+               uint8_t qos) {
+    uint16_t const tlen = strlen(topic);
+    uint32_t rlen = 2 + tlen + (qos ? 2 : 0) + len;
+
+    packet.clear();
+    packet.push_back(0x30 | qos << 1);
+    do {
+      packet.push_back((rlen & 0x7f) | (rlen > 0x7f ? 0x80 : 0));
+      rlen >>= 7;
+    } while (rlen);
+    packet.push_back(tlen >> 8);
+    packet.push_back(tlen & 0xff);
+    packet.insert(packet.end(), topic, topic + tlen);
+    if (qos) {
+      packetid++;
+      packet.push_back(packetid >> 8);
+      packet.push_back(packetid & 0xff);
+    }
+    packet.insert(packet.end(), payload, payload + len);
+    if (!writen(fd, packet.data(), packet.size()))
+      return false;
+
+    if (qos) {
+      uint8_t ack[4];
+      if (!readn(fd, ack, 4) || ack[0] != 0x40 ||
+          (ack[2] << 8 | ack[3]) != packetid)
+        return false;
+    }
+    return true;
+  }
+};
+
+static std::vector<MessageBuffer_t> messages(long n) {
+  // cyclic counts, some status, GPS and sensor payloads
+  static const uint8_t ports[] = {1, 1, 1, 1, 1, 1, 2, 4, 7, 10};
+  static const uint8_t sizes[] = {4, 4, 4, 4, 4, 4, 20, 13, 8, 12};
+  std::mt19937 rng(1);
+  std::vector<MessageBuffer_t> v(n);
+  for (MessageBuffer_t &m : v) {
+    int k = rng() % sizeof(ports);
+    m.MessagePort = ports[k];
+    m.MessageSize = sizes[k];
+    for (int i = 0; i < m.MessageSize; i++)
+      m.Message[i] = (uint8_t)rng();
+  }
+  return v;
+}
+
+static bool run(const char *name, const std::vector<MessageBuffer_t> &in,
+                uint8_t qos, uint8_t batchmax, uint16_t batchsize,
+                long ackdelay_us) {
+  Broker broker;
+  sockaddr_in addr = {};
+  Batched = (batchmax > 1);
+  socklen_t alen = sizeof(addr);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  broker.listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (bind(broker.listenfd, (sockaddr *)&addr, sizeof(addr)) ||
+      listen(broker.listenfd, 1) ||
+      getsockname(broker.listenfd, (sockaddr *)&addr, &alen)) {
+    perror("broker");
+    exit(2);
+  }
+  broker.ackdelay_us = ackdelay_us;
+  for (const MessageBuffer_t &m : in)
+    broker.expect[std::string(MQTT_OUTTOPIC "/") +
+                  std::to_string(m.MessagePort)]
+        .push_back(std::vector<uint8_t>(m.Message, m.Message + m.MessageSize));
+  std::thread server(&Broker::serve, &broker);
+
+  Client client;
+  int one = 1;
+  client.fd = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(client.fd, (sockaddr *)&addr, sizeof(addr))) {
+    perror("client");
+    exit(2);
+  }
+
+  static const uint32_t size[] = {SEND_QUEUE_SIZE};
+  MqttOutbox_t outbox(size);
+  MessageBuffer_t *batch[MQTT_BATCH_MAX], *evicted;
+  std::vector<char> payload(batchsize);
+  long next = 0, publishes = 0;
+  uint16_t len;
+  char topic[16];
+
+  auto start = std::chrono::steady_clock::now();
+  while (next < (long)in.size() || outbox.waiting()) {
+    // fetch from send queue, which is never short of messages here
+    while (next < (long)in.size() && outbox.waiting() < SEND_QUEUE_SIZE)
+      outbox.push((MessageBuffer_t *)&in[next++], 0, evicted);
+
+    uint8_t n = mqtt_batch(outbox, batch, batchmax, payload.data(), batchsize,
+                           &len, encode);
+    snprintf(topic, 16, "%s/%u", MQTT_OUTTOPIC, batch[0]->MessagePort);
+    if (!client.publish(topic, payload.data(), len, qos))
+      break;
+    publishes++;
+    for (uint8_t i = 0; i < n; i++)
+      outbox.remove(batch[i]);
+  }
+  uint8_t disconnect[2] = {0xe0, 0};
+  writen(client.fd, disconnect, 2);
+  server.join();
+  auto end = std::chrono::steady_clock::now();
+  close(client.fd);
+  close(broker.listenfd);
+
+  double const s = std::chrono::duration<double>(end - start).count();
+  bool const ok = !broker.errors && broker.received == (long)in.size();
+  printf("qos %u  %-7s %-8s %7ld messages %6ld publishes %5.1f bytes/message "
+         "%9.0f messages/s  %s\n",
+         qos, Format == MQTT_FORMAT_RAW    ? "raw"
+              : Format == MQTT_FORMAT_JSON ? "json"
+                                           : "base64",
+         name, (long)in.size(), publishes, (double)broker.bytes / in.size(),
+         in.size() / s, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  long n = 20000, ackdelay_us = 0;
+  uint16_t batchsize = 256;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:d:b:f:")) != -1)
+    switch (c) {
+    case 'n':
+      n = atol(optarg);
+      break;
+    case 'd':
+      ackdelay_us = atol(optarg);
+      break;
+    case 'b':
+      batchsize = atoi(optarg);
+      break;
+    case 'f':
+      Format = !strcmp(optarg, "raw")    ? MQTT_FORMAT_RAW
+               : !strcmp(optarg, "json") ? MQTT_FORMAT_JSON
+                                         : MQTT_FORMAT_BASE64;
+      break;
+    default:
+      fprintf(stderr, "usage: mqttbench [-n messages] [-d ackdelay_us] "
+                      "[-b batchsize] [-f base64|raw|json]\n");
+      return 2;
+    }
+  if (batchsize < MQTT_ENCODED_MAX(PAYLOAD_BUFFER_SIZE)) {
+    fprintf(stderr, "batchsize must be at least %u\n",
+            MQTT_ENCODED_MAX(PAYLOAD_BUFFER_SIZE));
+    return 2;
+  }
+
+  std::vector<MessageBuffer_t> in = messages(n);
+  bool ok = true;
+  for (uint8_t qos = 0; qos < 2; qos++) {
+    ok = run("single", in, qos, 1, batchsize, ackdelay_us) && ok;
+    ok = run("batched", in, qos, MQTT_BATCH_MAX, batchsize, ackdelay_us) && ok;
+  }
+  return ok ? 0 : 1;
+}
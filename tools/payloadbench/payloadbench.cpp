@@ -0,0 +1,227 @@
+// payloadbench.cpp
+// Host microbenchmark of payload encoding, plain and packed format.
+//
+// Encodes the records of a full status cycle (counts, window, status, MAC
+// pipeline, GPS, time) over and over, once with byte by byte writers as
+// PayloadConvert used them before, once with the schemas of payloadschema.h
+// written after one capacity check per record, as PayloadConvert does now.
+// Both must produce the same bytes, the tool exits with 1 otherwise.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o payloadbench payloadbench.cpp
+// usage: payloadbench [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "payloadschema.h"
+
+#define BUFFER_SIZE 255 // large enough for all records of one round
+
+typedef struct {
+  uint16_t wifi, ble, window[3], voltage;
+  uint64_t uptime;
+  uint8_t cputemp, reset0;
+  uint32_t mem, restarts;
+  uint32_t analyzed[2], dropped[2], filtered[2];
+  uint16_t p50[2], p99[2];
+  uint8_t peak[2];
+  int32_t latitude, longitude;
+  uint8_t sats;
+  uint16_t hdop;
+  int16_t altitude;
+  uint32_t time;
+} Sample_t;
+
+/* ---------------- byte by byte, as before ---------- */
+
+class LegacyPlain {
+public:
+  uint8_t buffer[BUFFER_SIZE], cursor;
+
+  void put16(uint16_t v) {
+    buffer[cursor++] = (uint8_t)(v >> 8);
+    buffer[cursor++] = (uint8_t)(v & 0xff);
+  }
+  void put32(uint32_t v) {
+    buffer[cursor++] = (uint8_t)((v & 0xFF000000) >> 24);
+    buffer[cursor++] = (uint8_t)((v & 0x00FF0000) >> 16);
+    buffer[cursor++] = (uint8_t)((v & 0x0000FF00) >> 8);
+    buffer[cursor++] = (uint8_t)((v & 0x000000FF));
+  }
+  void put64(uint64_t v) {
+    put32((uint32_t)(v >> 32));
+    put32((uint32_t)v);
+  }
+
+  void encode(const Sample_t &s) {
+    cursor = 0;
+    put16(s.wifi);
+    put16(s.ble);
+    for (int i = 0; i < 3; i++)
+      put16(s.window[i]);
+    put16(s.voltage);
+    put64(s.uptime);
+    buffer[cursor++] = s.cputemp;
+    put32(s.mem);
+    buffer[cursor++] = s.reset0;
+    put32(s.restarts);
+    for (int i = 0; i < 2; i++) {
+      put32(s.analyzed[i]);
+      put32(s.dropped[i]);
+      put32(s.filtered[i]);
+      put16(s.p50[i]);
+      put16(s.p99[i]);
+      buffer[cursor++] = s.peak[i];
+    }
+    put32(s.latitude);
+    put32(s.longitude);
+    buffer[cursor++] = s.sats;
+    put16(s.hdop);
+    put16(s.altitude);
+    put32(s.time);
+  }
+};
+
+class LegacyPacked {
+public:
+  uint8_t buffer[BUFFER_SIZE], cursor;
+
+  void uintToBytes(uint64_t value, uint8_t byteSize) {
+    for (uint8_t x = 0; x < byteSize; x++) {
+      uint8_t next = 0;
+      if (sizeof(value) > x) {
+        next = static_cast<uint8_t>((value >> (x * 8)) & 0xFF);
+      }
+      buffer[cursor] = next;
+      ++cursor;
+    }
+  }
+
+  void encode(const Sample_t &s) {
+    cursor = 0;
+    uintToBytes(s.wifi, 2);
+    uintToBytes(s.ble, 2);
+    for (int i = 0; i < 3; i++)
+      uintToBytes(s.window[i], 2);
+    uintToBytes(s.voltage, 2);
+    uintToBytes(s.uptime, 8);
+    uintToBytes(s.cputemp, 1);
+    uintToBytes(s.mem, 4);
+    uintToBytes(s.reset0, 1);
+    uintToBytes(s.restarts, 4);
+    for (int i = 0; i < 2; i++) {
+      uintToBytes(s.analyzed[i], 4);
+      uintToBytes(s.dropped[i], 4);
+      uintToBytes(s.filtered[i], 4);
+      uintToBytes(s.p50[i], 2);
+      uintToBytes(s.p99[i], 2);
+      uintToBytes(s.peak[i], 1);
+    }
+    uintToBytes((uint32_t)s.latitude, 4);
+    uintToBytes((uint32_t)s.longitude, 4);
+    uintToBytes(s.sats, 1);
+    uintToBytes(s.hdop, 2);
+    uintToBytes((uint16_t)s.altitude, 2);
+    uintToBytes(s.time, 4);
+  }
+};
+
+/* ---------------- schemas, one check per record ---------- */
+
+template <bool MSB> class Schema {
+public:
+  uint8_t buffer[BUFFER_SIZE], cursor, maxsize = BUFFER_SIZE;
+
+  uint8_t *reserve(uint8_t size) {
+    if (size > maxsize - cursor)
+      return NULL;
+    uint8_t *record = buffer + cursor;
+    cursor += size;
+    return record;
+  }
+
+  template <class S, class... V> void write(V... values) {
+    uint8_t *p = reserve(S::size);
+    if (p)
+      S::template encode<MSB>(p, values...);
+  }
+
+  void encode(const Sample_t &s) {
+    cursor = 0;
+    write<CountSchema>(s.wifi);
+    write<CountSchema>(s.ble);
+    write<WindowSchema>(s.window[0], s.window[1], s.window[2]);
+    write<StatusSchema>(s.voltage, s.uptime, s.cputemp, s.mem, s.reset0,
+                        s.restarts);
+    write<WifiPipelineSchema>(s.analyzed[0], s.dropped[0], s.filtered[0],
+                              s.p50[0], s.p99[0], s.peak[0]);
+    write<BlePipelineSchema>(s.analyzed[1], s.dropped[1], s.filtered[1],
+                             s.p50[1], s.p99[1], s.peak[1]);
+    write<GpsSchema>(s.latitude, s.longitude, s.sats, s.hdop, s.altitude);
+    write<TimeSchema>(s.time);
+  }
+};
+
+/* ---------------- benchmark ---------- */
+
+static std::vector<Sample_t> samples(size_t n) {
+  std::mt19937_64 rng(1);
+  std::vector<Sample_t> v(n);
+  for (Sample_t &s : v) {
+    uint8_t *p = (uint8_t *)&s;
+    for (size_t i = 0; i < sizeof(s); i++)
+      p[i] = (uint8_t)rng();
+  }
+  return v;
+}
+
+template <class E>
+static double run(E &encoder, const std::vector<Sample_t> &in, long rounds,
+                  uint32_t &check) {
+  auto start = std::chrono::steady_clock::now();
+  for (long r = 0; r < rounds; r++)
+    for (const Sample_t &s : in) {
+      encoder.encode(s);
+      check = check * 31 + encoder.buffer[encoder.cursor - 1] +
+              encoder.buffer[r % encoder.cursor];
+    }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         ((double)rounds * in.size());
+}
+
+template <class L, class S>
+static bool bench(const char *name, const std::vector<Sample_t> &in,
+                  long rounds) {
+  static L legacy;
+  static S schema;
+  uint32_t c1 = 0, c2 = 0;
+
+  for (const Sample_t &s : in) {
+    legacy.encode(s);
+    schema.encode(s);
+    if (legacy.cursor != schema.cursor ||
+        memcmp(legacy.buffer, schema.buffer, legacy.cursor)) {
+      printf("%s: output differs\n", name);
+      return false;
+    }
+  }
+
+  double t1 = run(legacy, in, rounds, c1);
+  double t2 = run(schema, in, rounds, c2);
+  printf("%-7s %3u bytes  byte by byte %6.1f ns  schema %6.1f ns  %.2fx\n",
+         name, legacy.cursor, t1, t2, t1 / t2);
+  return c1 == c2;
+}
+
+int main(int argc, char **argv) {
+  long rounds = argc > 1 ? atol(argv[1]) : 2000;
+  std::vector<Sample_t> in = samples(1000);
+  bool ok = bench<LegacyPlain, Schema<true>>("plain", in, rounds) &
+            bench<LegacyPacked, Schema<false>>("packed", in, rounds);
+  return ok ? 0 : 1;
+}
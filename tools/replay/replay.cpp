@@ -0,0 +1,357 @@
+// replay.cpp
+// Host tool replaying MAC traces through the paxcounter counting core.
+//
+// Frames are run through MacCounter (maccounter.h), the same core as used by
+// mac_add(), mac_analyze() and reset_counters() on the device, and the tool
+// reports throughput, memory footprint, ring drops and count accuracy against
+// exact counting of the full 6 byte MACs.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o replay replay.cpp
+// usage: replay [-b hashbits] [-c cycle] [-m countermode] [-p us]
+//               [-r rssilimit] [-d] [trace]
+//
+//   -b  width of hashed MACs, 16, 24 or 32 [16]
+//   -c  send cycle in seconds [60]
+//   -m  0 = cyclic, counters are reset after each cycle, 1 = cumulative,
+//       counters are estimated by HyperLogLog sketches [0]
+//   -p  time MAC processing task takes per frame, in microseconds, 0 = it
+//       keeps up with every frame [0]
+//   -r  RSSI limit, negative value, 0 = off [0]
+//   -d  disable early duplicate filter
+//
+// With -p, the MAC processing task is modelled as a single consumer taking
+// MAC_BATCH_SIZE frames from each ring in turn, as mac_process() does, so
+// frames lost in bursts and the latency of counting show up. This is the
+// harness for sizing MAC_QUEUE_SIZE and MAC_DEDUP_SIZE against crowdgen
+// traces. Feature and size defines are those of paxcounter.conf and may be
+// overridden with -D at build, e.g. -DMAC_QUEUE_SIZE=100 -DMAC_DEDUP_SIZE=0.
+//
+// Trace is read from file or stdin, one sniffed frame per line:
+//
+//   <milliseconds>,<w|b>,<rssi>,<aa:bb:cc:dd:ee:ff>
+//
+// Lines starting with # are ignored. Timestamps must not decrease.
+// Synthetic traces can be made with tools/crowdgen.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <unordered_set>
+#include <sys/resource.h>
+
+// defaults as in paxcounter_orig.conf, override with -D at build
+#ifndef MAC_QUEUE_SIZE
+#define MAC_QUEUE_SIZE 50
+#endif
+#ifndef MAC_DEDUP_SIZE
+#define MAC_DEDUP_SIZE 64
+#endif
+#ifndef MAC_SET_CROWD
+#define MAC_SET_CROWD 5000
+#endif
+#ifndef MAC_SET_SLOTS
+#define MAC_SET_SLOTS macset_slots(MAC_SET_CROWD)
+#endif
+// sketches and sliding window are always compiled in, to report them
+#define HLL_COUNTER 1
+#define HLL_PRECISION 11
+#define SLIDING_WINDOW 1
+#define SLIDING_WINDOW_BUCKET 5
+#define SLIDING_WINDOW_BUCKETS 13
+#define SLIDING_WINDOW_PRECISION 9
+#define SLIDING_WINDOW_LONG 60
+// as in macsniff.h
+#define MAC_BATCH_SIZE 16
+
+#include "maccounter.h"
+
+typedef struct {
+  uint32_t ms;
+  uint8_t ble;
+  int8_t rssi;
+  uint8_t mac[8]; // 6 bytes used, padded for 8 byte loads
+} Frame_t;
+
+typedef struct {
+  uint32_t cycle;
+  uint32_t service; // [us] per frame in MAC processing task
+  uint8_t countermode;
+  int8_t rssilimit;
+  bool dedup;
+} Options_t;
+
+typedef struct {
+  uint32_t cycles;
+  double abserr, maxerr;    // per cycle count error [%]
+  uint32_t truth, counted;  // last cycle
+  uint32_t hlltruth;        // cumulative, whole trace
+  uint32_t win, wintruth;   // last 60 minutes of trace
+  uint32_t dedup_hits;      // frames dropped by duplicate filter
+  uint32_t drops;           // frames lost due to full rings
+  uint32_t peak;            // max. frames waiting in one ring
+  double latency;           // [ms] max. time from sniffing to counting
+  uint32_t overflow, full;  // inserts rejected by full MacSet, in cycles
+  size_t footprint;         // bytes of counting structures
+  double seconds;           // time spent in counting core
+} Result_t;
+
+static uint64_t mac48(const uint8_t *mac) {
+  uint64_t m = 0;
+  memcpy(&m, mac, 6);
+  return m;
+}
+
+static bool parse(char *line, Frame_t &f) {
+  unsigned int m[6];
+  char type;
+  int rssi;
+  unsigned long ms;
+  if (line[0] == '#' || line[0] == '\n')
+    return false;
+  if (sscanf(line, "%lu,%c,%d,%x:%x:%x:%x:%x:%x", &ms, &type, &rssi, &m[0],
+             &m[1], &m[2], &m[3], &m[4], &m[5]) != 9)
+    return false;
+  memset(&f, 0, sizeof(f));
+  f.ms = ms;
+  f.ble = (type == 'b');
+  f.rssi = rssi;
+  for (int i = 0; i < 6; i++)
+    f.mac[i] = m[i];
+  return true;
+}
+
+// exact counts of full MACs at end of each cycle, cumulative and in last 60
+// minutes
+static void exact(const std::vector<Frame_t> &trace, const Options_t &opt,
+                  std::vector<uint32_t> &cycles, Result_t &res) {
+
+  std::unordered_set<uint64_t> cycle, cumulative, recent;
+  uint32_t cycle_end = opt.cycle * 1000UL;
+  const uint32_t end = trace.empty() ? 0 : trace.back().ms;
+
+  for (const Frame_t &f : trace) {
+    while (f.ms >= cycle_end) {
+      cycles.push_back(opt.countermode == 1 ? cumulative.size()
+                                            : cycle.size());
+      cycle.clear();
+      cycle_end += opt.cycle * 1000UL;
+    }
+    if (opt.rssilimit && f.rssi < opt.rssilimit)
+      continue;
+    cycle.insert(mac48(f.mac));
+    cumulative.insert(mac48(f.mac));
+    if (end - f.ms < 3600000UL)
+      recent.insert(mac48(f.mac));
+  }
+  cycles.push_back(opt.countermode == 1 ? cumulative.size() : cycle.size());
+  res.hlltruth = cumulative.size();
+  res.wintruth = recent.size();
+}
+
+// feeds trace through counting core, as sniffer callbacks, mac_process() and
+// reset_counters() do on the device
+template <uint8_t BITS>
+static void run(const std::vector<Frame_t> &trace, const Options_t &opt,
+                std::vector<uint32_t> &cycles, Result_t &res) {
+
+  typedef MacSet<BITS, MAC_SET_SLOTS> Set_t;
+  typedef MacCounter<Set_t> Counter_t;
+  static Set_t macs;
+  static volatile uint16_t macs_wifi, macs_ble;
+  static Counter_t core(macs, macs_wifi, macs_ble);
+
+  std::mt19937 rng(42);
+  const bool cumulative = (opt.countermode == 1);
+  // duplicate filter is bypassed on the device in beacon monitor mode only
+  const bool monitormode = !opt.dedup;
+  uint32_t cycle_end = opt.cycle * 1000UL;
+  typename Counter_t::key_t hashedmac;
+  MacBuffer_t MacBuffer;
+  uint64_t busy = 0; // [us] time MAC processing task is busy until
+  snifftype_t turn = MAC_SNIFF_WIFI;
+  uint8_t batch = 0;
+
+  // MAC processing task, runs until it catches up with <now>
+  auto process = [&](uint64_t now) {
+    while (busy <= now) {
+      if (batch == MAC_BATCH_SIZE || core.ring(turn).empty()) {
+        const snifftype_t other =
+            (turn == MAC_SNIFF_WIFI) ? MAC_SNIFF_BLE : MAC_SNIFF_WIFI;
+        batch = 0;
+        if (!core.ring(other).empty())
+          turn = other;
+        else if (core.ring(turn).empty())
+          break;
+      }
+      core.ring(turn).pop(MacBuffer);
+      batch++;
+      // 32 bit stamp is expanded against <now>, frames wait less than 71 min
+      const uint64_t stamp = now - (uint32_t)((uint32_t)now - MacBuffer.stamp);
+      busy = std::max(busy, stamp) + opt.service;
+      res.latency = std::max(res.latency, (busy - stamp) / 1000.0);
+      core.analyze(MacBuffer, opt.rssilimit, cumulative,
+                   Counter_t::epoch(busy / 1000), hashedmac);
+    }
+  };
+
+  res.footprint = sizeof(macs) + sizeof(core);
+  cycles.clear();
+  core.rekey(rng(), rng());
+  core.reset();
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  for (const Frame_t &f : trace) {
+
+    // send cycle, counters are reset in cyclic counter mode only
+    while (f.ms >= cycle_end) {
+      process(cycle_end * 1000ULL);
+      cycles.push_back(macs_wifi + macs_ble);
+      res.overflow += macs.overflow();
+      res.full += macs.overflow() > 0;
+      if (!cumulative) {
+        core.reset();
+        core.rekey(rng(), rng());
+      }
+      cycle_end += opt.cycle * 1000UL;
+    }
+
+    // sniffer callback
+    const uint64_t now = f.ms * 1000ULL;
+    const snifftype_t type = f.ble ? MAC_SNIFF_BLE : MAC_SNIFF_WIFI;
+    process(now);
+    core.add(f.mac, f.rssi, type, (uint32_t)now, opt.rssilimit, monitormode);
+    res.peak = std::max(res.peak, core.ring(type).waiting());
+    if (!opt.service)
+      process(now);
+  }
+  if (!trace.empty())
+    process(UINT64_MAX - UINT32_MAX);
+  cycles.push_back(macs_wifi + macs_ble);
+  res.overflow += macs.overflow();
+  res.full += macs.overflow() > 0;
+
+  res.seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count();
+  res.dedup_hits =
+      core.dedup_hits(MAC_SNIFF_WIFI) + core.dedup_hits(MAC_SNIFF_BLE);
+  res.drops = core.drops(MAC_SNIFF_WIFI) + core.drops(MAC_SNIFF_BLE);
+  if (!trace.empty())
+    res.win = core.window_count(60, trace.back().ms);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: replay [-b 16|24|32] [-c cycle] [-m 0|1] [-p us] "
+                  "[-r rssilimit] [-d] [trace]\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+
+  Options_t opt = {60, 0, 0, 0, true};
+  int bits = 16, c;
+
+  while ((c = getopt(argc, argv, "b:c:m:p:r:d")) != -1) {
+    switch (c) {
+    case 'b':
+      bits = atoi(optarg);
+      break;
+    case 'c':
+      opt.cycle = atoi(optarg);
+      break;
+    case 'm':
+      opt.countermode = atoi(optarg);
+      break;
+    case 'p':
+      opt.service = atoi(optarg);
+      break;
+    case 'r':
+      opt.rssilimit = atoi(optarg);
+      break;
+    case 'd':
+      opt.dedup = false;
+      break;
+    default:
+      usage();
+    }
+  }
+  if ((bits != 16 && bits != 24 && bits != 32) || !opt.cycle ||
+      opt.countermode > 1)
+    usage();
+
+  FILE *in = (optind < argc) ? fopen(argv[optind], "r") : stdin;
+  if (!in) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  std::vector<Frame_t> trace;
+  char line[128];
+  Frame_t f;
+  while (fgets(line, sizeof(line), in))
+    if (parse(line, f))
+      trace.push_back(f);
+  if (in != stdin)
+    fclose(in);
+
+  Result_t res = Result_t();
+  std::vector<uint32_t> truth, counted;
+  exact(trace, opt, truth, res);
+  if (bits == 16)
+    run<16>(trace, opt, counted, res);
+  else if (bits == 24)
+    run<24>(trace, opt, counted, res);
+  else
+    run<32>(trace, opt, counted, res);
+
+  for (size_t i = 0; i < truth.size() && i < counted.size(); i++) {
+    if (!truth[i])
+      continue;
+    const double err =
+        100.0 * fabs((double)counted[i] - truth[i]) / (double)truth[i];
+    res.abserr += err;
+    res.maxerr = std::max(res.maxerr, err);
+    res.truth = truth[i];
+    res.counted = counted[i];
+    res.cycles++;
+  }
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  printf("frames             %zu\n", trace.size());
+  printf("throughput         %.0f frames/s (%.1f ns/frame)\n",
+         res.seconds ? trace.size() / res.seconds : 0,
+         trace.size() ? 1e9 * res.seconds / trace.size() : 0);
+  printf("duplicate filter   %u frames dropped\n", res.dedup_hits);
+  printf("MAC rings          %u frames lost, peak %u of %u slots waiting\n",
+         res.drops, res.peak, MAC_QUEUE_SIZE);
+  printf("MAC processing     %u us per frame, max latency %.1f ms\n",
+         opt.service, res.latency);
+  printf("core footprint     %zu bytes (hash width %d bit)\n", res.footprint,
+         bits);
+  printf("process max rss    %ld KB\n", ru.ru_maxrss);
+  printf("cycles             %u of %u s, %s counter\n", res.cycles,
+         opt.cycle, opt.countermode == 1 ? "cumulative" : "cyclic");
+  printf("cycle count error  mean %.2f %%, max %.2f %%\n",
+         res.cycles ? res.abserr / res.cycles : 0, res.maxerr);
+  printf("last cycle         %u counted, %u exact\n", res.counted, res.truth);
+  if (res.overflow)
+    printf("MAC container full %u inserts of new MACs rejected in %u cycles, "
+           "raise MAC_SET_CROWD (%u)\n",
+           res.overflow, res.full, MAC_SET_CROWD);
+  if (opt.countermode != 1)
+    printf("cumulative         %u exact, see -m 1 for HLL estimate\n",
+           res.hlltruth);
+  printf("last 60 min window %u estimated, %u exact\n", res.win,
+         res.wintruth);
+
+  return 0;
+}
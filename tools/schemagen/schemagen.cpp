@@ -0,0 +1,316 @@
+// schemagen.cpp
+// Host tool for the payload schemas of plain and packed encoder.
+//
+// Prints TTN decoder blocks for the ports described by payloadschema.h, test
+// vectors to check decoders against, and checks encode -> decode round trips
+// of every schema PayloadConvert writes, in both byte orders.
+//
+// build: g++ -O2 -std=c++14 -I../../include -o schemagen schemagen.cpp
+// usage: schemagen plain|packed [-3]
+//        schemagen verify decoder.js [-3]
+//        schemagen vectors plain|packed [rounds]
+//        schemagen check [rounds]
+//
+//   plain, packed  print decoder blocks for src/TTN, or src/TTNv3 with -3
+//   verify         check that a plain decoder contains the blocks it takes as
+//                  printed, exit code 1 if one is missing or differs
+//   vectors        print random payloads with their field values, one JSON
+//                  object per line
+//   check          run round trips, exit code 1 on mismatch [100000 rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "payloadschema.h"
+
+using namespace PayloadField;
+
+typedef struct {
+  const char *name, *js;
+  uint8_t size;
+  bool is_signed;
+} FieldInfo_t;
+
+typedef struct {
+  uint8_t port;
+  uint8_t size;
+  bool verbatim; // plain decoders contain the printed block unchanged
+  std::vector<FieldInfo_t> fields;
+} Layout_t;
+
+struct Collect {
+  std::vector<FieldInfo_t> &fields;
+  template <class F> void field(void) {
+    fields.push_back({F::name(), F::js(), F::size, F::is_signed});
+  }
+};
+
+template <class S>
+static Layout_t layout(uint8_t port, bool verbatim = false) {
+  Layout_t l{port, S::size, verbatim, {}};
+  Collect c{l.fields};
+  S::visit(c);
+  return l;
+}
+
+// payloads as sent on each port, told apart by length as in TTN decoders
+static std::vector<Layout_t> layouts(void) {
+  return {
+      layout<CountSchema>(1),
+      layout<PayloadSchema<wifi, ble>>(1),
+      layout<PayloadSchema<wifi, GpsSchema>>(1),
+      layout<PayloadSchema<wifi, ble, GpsSchema>>(1),
+      layout<StatusSchema>(2, true),
+      layout<PayloadSchema<WifiPipelineSchema, BlePipelineSchema>>(2, true),
+      layout<GpsSchema>(4),
+      layout<ButtonSchema>(5),
+      layout<AlarmSchema>(6),
+      layout<VoltageSchema>(8),
+      layout<PayloadSchema<TimeSchema, timestatus>>(9),
+      layout<PayloadSchema<ens>>(10),
+      layout<WindowSchema>(13),
+  };
+}
+
+/* ---------------- decoder output ---------- */
+
+static const char *Bytes = "bytes", *Decoded = "decoded", *Port = "port",
+                  *Indent = "  ";
+
+// big endian read of one field as javascript expression
+static std::string plain_expr(const FieldInfo_t &f) {
+  char b[24];
+  std::string byte[8];
+  for (int i = 0; i < f.size; i++)
+    byte[i] = std::string(Bytes) + "[i++]";
+
+  switch (f.size) {
+  case 1:
+    return f.is_signed ? "(" + byte[0] + " << 24) >> 24" : byte[0];
+  case 2:
+    return f.is_signed ? "((" + byte[0] + " << 24) | (" + byte[1] +
+                             " << 16)) >> 16"
+                       : "(" + byte[0] + " << 8) | " + byte[1];
+  case 4: {
+    std::string e = "((" + byte[0] + " << 24) | (" + byte[1] + " << 16) | (" +
+                    byte[2] + " << 8) | " + byte[3] + ")";
+    return f.is_signed ? e : e + " >>> 0";
+  }
+  default: // 8 bytes, javascript bit operators are 32 bit only
+    std::string e;
+    for (int i = 0; i < f.size; i++) {
+      snprintf(b, sizeof(b), " * %.0f",
+               (double)(1ULL << (8 * (f.size - 1 - i))));
+      e += (i ? " + " : "") + byte[i] + (i < f.size - 1 ? b : "");
+    }
+    return e;
+  }
+}
+
+static std::string plain_block(const Layout_t &l) {
+  char b[80];
+  std::string in(Indent), e;
+  snprintf(b, sizeof(b), "if (%s === %u && %s.length === %u) {\n", Port,
+           l.port, Bytes, l.size);
+  e = in + b + in + in + "var i = 0;\n";
+  for (const FieldInfo_t &f : l.fields)
+    e += in + in + Decoded + "." + f.name + " = " + plain_expr(f) + ";\n";
+  return e + in + "}\n";
+}
+
+static void print_plain(const std::vector<Layout_t> &all) {
+  for (const Layout_t &l : all)
+    printf("%s\n", plain_block(l).c_str());
+}
+
+static int verify_plain(const std::vector<Layout_t> &all, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return 2;
+  }
+  std::string js;
+  char b[4096];
+  size_t n;
+  while ((n = fread(b, 1, sizeof(b), f)))
+    js.append(b, n);
+  fclose(f);
+
+  int missing = 0;
+  for (const Layout_t &l : all)
+    if (l.verbatim && js.find(plain_block(l)) == std::string::npos) {
+      printf("%s: port %u, %u bytes differs, expected\n%s", path, l.port,
+             l.size, plain_block(l).c_str());
+      missing++;
+    }
+  if (!missing)
+    printf("%s ok\n", path);
+  return missing ? 1 : 0;
+}
+
+static void print_packed(const std::vector<Layout_t> &all) {
+  for (size_t n = 0; n < all.size(); n++) {
+    const Layout_t &l = all[n];
+    if (!n || all[n - 1].port != l.port)
+      printf("    if (%s === %u) {\n", Port, l.port);
+    printf("        if (%s.length === %u) {\n", Bytes, l.size);
+    printf("            %s = decode(%s, [", Decoded, Bytes);
+    for (size_t i = 0; i < l.fields.size(); i++)
+      printf("%s%s", i ? ", " : "", l.fields[i].js);
+    printf("], [");
+    for (size_t i = 0; i < l.fields.size(); i++)
+      printf("%s'%s'", i ? ", " : "", l.fields[i].name);
+    printf("]);\n        }\n");
+    if (n + 1 == all.size() || all[n + 1].port != l.port)
+      printf("    }\n\n");
+  }
+}
+
+/* ---------------- test vectors ---------- */
+
+static std::mt19937_64 rng(1);
+
+static void print_vectors(const std::vector<Layout_t> &all, bool msb,
+                          long rounds) {
+  for (long r = 0; r < rounds; r++)
+    for (const Layout_t &l : all) {
+      uint8_t buf[256];
+      uint8_t *p = buf;
+      printf("{\"port\":%u,\"fields\":{", l.port);
+      for (size_t i = 0; i < l.fields.size(); i++) {
+        const FieldInfo_t &f = l.fields[i];
+        uint64_t v = rng();
+        int bits = 8 * f.size;
+        if (bits < 64)
+          v &= (1ULL << bits) - 1;
+        for (int k = 0; k < f.size; k++)
+          p[msb ? f.size - 1 - k : k] = (uint8_t)(v >> (8 * k));
+        p += f.size;
+        if (f.is_signed && bits < 64 && (v >> (bits - 1)))
+          printf("%s\"%s\":%lld", i ? "," : "", f.name,
+                 (long long)v - (1LL << bits));
+        else
+          printf("%s\"%s\":%llu", i ? "," : "", f.name, (unsigned long long)v);
+      }
+      printf("},\"bytes\":[");
+      for (int i = 0; i < l.size; i++)
+        printf("%s%u", i ? "," : "", buf[i]);
+      printf("]}\n");
+    }
+}
+
+/* ---------------- round trip check ---------- */
+
+template <class T> static T random_value(void) { return (T)rng(); }
+
+template <bool MSB, class... F, size_t... I>
+static bool roundtrip(PayloadSchema<F...>, std::index_sequence<I...>) {
+  typedef PayloadSchema<F...> S;
+  std::tuple<typename F::type...> in(random_value<typename F::type>()...),
+      out;
+  uint8_t buf[S::size + 1];
+  const uint8_t *p = buf;
+  bool ok = true;
+
+  buf[S::size] = 0xa5; // guard
+  S::template encode<MSB>(buf, std::get<I>(in)...);
+  S::template decode<MSB>(buf, std::get<I>(out)...);
+
+  // byte order against host memory layout (little endian)
+  auto order = [&](auto value, uint8_t size) {
+    uint8_t ref[8];
+    memcpy(ref, &value, sizeof(value));
+    for (uint8_t k = 0; k < size; k++)
+      if (p[k] != ref[MSB ? size - 1 - k : k])
+        ok = false;
+    p += size;
+    return 0;
+  };
+  (void)std::initializer_list<int>{order(std::get<I>(in), F::size)...};
+
+  return ok && in == out && buf[S::size] == 0xa5 && p == buf + S::size;
+}
+
+template <bool MSB, class... F>
+static long check_schema(PayloadSchema<F...> s, long rounds) {
+  long errors = 0;
+  for (long r = 0; r < rounds; r++)
+    if (!roundtrip<MSB>(s, std::index_sequence_for<F...>()))
+      errors++;
+  return errors;
+}
+
+template <class S> static long check(const char *name, long rounds, long &n) {
+  long errors = check_schema<true>(S(), rounds) +
+                check_schema<false>(S(), rounds);
+  printf("%-20s %3u bytes  %s\n", name, S::size, errors ? "FAILED" : "ok");
+  n++;
+  return errors;
+}
+
+static int run_check(long rounds) {
+  long errors = 0, n = 0;
+  errors += check<CountSchema>("CountSchema", rounds, n);
+  errors += check<WindowSchema>("WindowSchema", rounds, n);
+  errors += check<AlarmSchema>("AlarmSchema", rounds, n);
+  errors += check<WifiPipelineSchema>("WifiPipelineSchema", rounds, n);
+  errors += check<BlePipelineSchema>("BlePipelineSchema", rounds, n);
+  errors += check<VoltageSchema>("VoltageSchema", rounds, n);
+  errors += check<StatusSchema>("StatusSchema", rounds, n);
+  errors += check<GpsSchema>("GpsSchema", rounds, n);
+  errors += check<ButtonSchema>("ButtonSchema", rounds, n);
+  errors += check<TimeSchema>("TimeSchema", rounds, n);
+  printf("%ld schemas, %ld round trips per byte order, %ld errors\n", n,
+         rounds, errors);
+  return errors ? 1 : 0;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: schemagen plain|packed [-3]\n"
+                  "       schemagen verify decoder.js [-3]\n"
+                  "       schemagen vectors plain|packed [rounds]\n"
+                  "       schemagen check [rounds]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2)
+    usage();
+
+  if (!strcmp(argv[1], "check"))
+    return run_check(argc > 2 ? atol(argv[2]) : 100000);
+
+  if (!strcmp(argv[1], "vectors")) {
+    if (argc < 3 || (strcmp(argv[2], "plain") && strcmp(argv[2], "packed")))
+      usage();
+    print_vectors(layouts(), !strcmp(argv[2], "plain"),
+                  argc > 3 ? atol(argv[3]) : 10);
+    return 0;
+  }
+
+  bool const v3 = !strcmp(argv[argc - 1], "-3");
+  if (v3) {
+    Bytes = "input.bytes";
+    Decoded = "data";
+    Port = "input.fPort";
+    Indent = "    ";
+  }
+  if (!strcmp(argv[1], "verify")) {
+    if (argc < 3 || argc > 3 + v3)
+      usage();
+    return verify_plain(layouts(), argv[2]);
+  }
+  if (!strcmp(argv[1], "plain"))
+    print_plain(layouts());
+  else if (!strcmp(argv[1], "packed"))
+    print_packed(layouts());
+  else
+    usage();
+  return 0;
+}
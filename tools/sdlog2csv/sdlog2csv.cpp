@@ -0,0 +1,192 @@
+// sdlog2csv.cpp
+// Converts binary SD-card logs (SDCARD_FORMAT 1) to CSV, as written by
+// SDCARD_FORMAT 0, see include/sdlog.h. Files are read sector by sector,
+// sectors without header are skipped and counted on stderr.
+//
+// With -t, runs random records through SdLog into memory, flushing at random
+// points as the firmware does every SDCARD_SYNC_SEC, and checks that all
+// records read back unchanged, that all writes start at sector aligned
+// offsets, and that only the last write before a flush ends inside a sector.
+// Then does the same in append mode, where all writes must start at the end
+// of the file.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o sdlog2csv sdlog2csv.cpp
+// usage: sdlog2csv file.bin ... > file.csv
+//        sdlog2csv -t [records]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <random>
+#include <vector>
+
+#include "sdlog.h"
+
+#define SDCARD_BUFFER_SECTORS 8 // as in sdcard.h
+
+static void header(uint8_t flags) {
+  printf("date, time, wifi, bluet%s%s\r\n", (flags & SDLOG_CWA) ? ",cwa" : "",
+         (flags & SDLOG_SDS011) ? ", PM10,PM25" : "");
+}
+
+static void row(const SdLogRecord_t &r, uint8_t flags) {
+  time_t const t = r.time;
+  struct tm tm;
+  gmtime_r(&t, &tm); // time is local time already
+  printf("%02d.%02d.%4d,%02d:%02d:%02d,%d,%d", tm.tm_mday, tm.tm_mon + 1,
+         tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec, r.wifi, r.ble);
+  if (flags & SDLOG_CWA)
+    printf(",%d", r.cwa);
+  if (flags & SDLOG_SDS011)
+    printf(",%5.1f,%4.1f", r.pm10 / 10.0, r.pm25 / 10.0);
+  printf("\r\n");
+}
+
+static bool convert(const char *name, bool &first) {
+  uint8_t sector[SDLOG_SECTOR];
+  long bad = 0;
+  size_t n;
+
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    perror(name);
+    return false;
+  }
+  while ((n = fread(sector, 1, SDLOG_SECTOR, f)) > 0) {
+    auto print = [&](uint8_t flags, const uint8_t *p, uint8_t len) {
+      SdLogRecord_t r;
+      if (first) {
+        header(flags);
+        first = false;
+      }
+      if (sdlog_decode(p, len, r, flags))
+        row(r, flags);
+    };
+    if (sdlog_parse(sector, n, print) < 0)
+      bad++;
+  }
+  fclose(f);
+  if (bad)
+    fprintf(stderr, "%s: %ld sector(s) without header skipped\n", name, bad);
+  return true;
+}
+
+// collects written file in memory. Counts writes which start inside a sector,
+// or other than at the end of file or at the begin of its partial sector, and
+// writes following one that ended inside a sector without a sync between,
+// which must be the partial sector written by flush(). In append mode counts
+// writes which start other than at the end of file.
+class MemWriter {
+
+public:
+  MemWriter(bool append) : append(append) {}
+
+  std::vector<uint8_t> file;
+  long writes = 0, unaligned = 0, rewritten = 0;
+
+  bool write(uint32_t pos, const uint8_t *data, uint32_t len) {
+    uint32_t const tail = file.size() % SDLOG_SECTOR;
+    if (append ? pos != file.size()
+               : open_end || pos % SDLOG_SECTOR ||
+                     (pos != file.size() && pos != file.size() - tail))
+      unaligned++;
+    if (pos < file.size()) {
+      rewritten += file.size() - pos;
+      file.resize(pos);
+    }
+    open_end = (pos + len) % SDLOG_SECTOR;
+    file.insert(file.end(), data, data + len);
+    writes++;
+    return true;
+  }
+  bool sync(void) {
+    open_end = false;
+    return true;
+  }
+
+private:
+  bool const append;
+  bool open_end = false;
+};
+
+static bool selftest(long records, bool append) {
+  std::mt19937 rng(1);
+  MemWriter out(append);
+  SdLog<MemWriter, SDCARD_BUFFER_SECTORS> log(out);
+  std::vector<SdLogRecord_t> sent;
+  std::vector<uint8_t> flagsof;
+  long errors = 0, got = 0, flushes = 0;
+
+  log.appendonly(append);
+  for (long i = 0; i < records; i++) {
+    SdLogRecord_t r = {(uint32_t)(1600000000 + 60 * i), (uint16_t)rng(),
+                       (uint16_t)rng(), (uint16_t)rng(), (uint16_t)rng(),
+                       (uint16_t)rng()};
+    uint8_t const flags = (i / 1000) % 4; // layout changes now and then
+    uint8_t rec[sizeof(SdLogRecord_t)];
+    if (!(flags & SDLOG_CWA))
+      r.cwa = 0;
+    if (!(flags & SDLOG_SDS011))
+      r.pm10 = r.pm25 = 0;
+    if (!log.record(flags, rec, sdlog_encode(rec, r, flags)))
+      errors++;
+    sent.push_back(r);
+    flagsof.push_back(flags);
+    if (rng() % 60 == 0) {
+      if (!log.flush())
+        errors++;
+      flushes++;
+    }
+  }
+  if (!log.flush())
+    errors++;
+  if (log.size() != out.file.size() || log.pending())
+    errors++;
+
+  for (size_t s = 0; s < out.file.size(); s += SDLOG_SECTOR) {
+    size_t const n = std::min<size_t>(SDLOG_SECTOR, out.file.size() - s);
+    sdlog_parse(out.file.data() + s, n,
+                [&](uint8_t flags, const uint8_t *p, uint8_t len) {
+                  SdLogRecord_t r;
+                  if (got >= (long)sent.size() || flags != flagsof[got] ||
+                      !sdlog_decode(p, len, r, flags) ||
+                      memcmp(&r, &sent[got], sizeof(r)))
+                    errors++;
+                  got++;
+                });
+  }
+  if (got != records)
+    errors++;
+
+  printf("%s\n", append ? "append mode" : "sector mode");
+  printf("binary records        %ld records, %zu bytes (%.1f per record, CSV "
+         "about 30), %ld flushes  %s\n",
+         got, out.file.size(), (double)out.file.size() / records, flushes,
+         errors ? "FAILED" : "ok");
+  printf("sector writes         %ld writes, %ld not %s, %ld bytes rewritten  "
+         "%s\n",
+         out.writes, out.unaligned, append ? "at end" : "sector aligned",
+         out.rewritten,
+         out.unaligned ? "FAILED" : "ok");
+  return !errors && !out.unaligned && !(append && out.rewritten);
+}
+
+int main(int argc, char **argv) {
+  bool first = true, ok = true;
+
+  if (argc > 1 && !strcmp(argv[1], "-t")) {
+    long const records = argc > 2 ? atol(argv[2]) : 100000;
+    ok = selftest(records, false);
+    ok = selftest(records, true) && ok;
+    return ok ? 0 : 1;
+  }
+  if (argc < 2) {
+    fprintf(stderr, "usage: sdlog2csv file.bin ... > file.csv\n"
+                    "       sdlog2csv -t [records]\n");
+    return 2;
+  }
+  for (int i = 1; i < argc; i++)
+    ok = convert(argv[i], first) && ok;
+  return ok ? 0 : 1;
+}
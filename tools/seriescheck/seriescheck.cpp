@@ -0,0 +1,150 @@
+// seriescheck.cpp
+// Host round trip check of the counter time series codec, see
+// include/seriescodec.h.
+//
+// Checks zig-zag and varint coding at their edge values, then appends random
+// walks of samples of 2 to 16 bytes, both byte orders, to delta series of
+// PAYLOAD_BUFFER_SIZE bytes until full, as lora_coalesce() does, and checks
+//
+//   - every sample decodes unchanged, also for counts wrapping at 0 / 65535,
+//   - a series never exceeds its max. size, and a full one stays unchanged,
+//   - a sample of other length than the series' samples is not appended,
+//   - every cut short series decodes to its first samples or is rejected,
+//     without reading past its end.
+//
+// Reports mean samples per series against raw format.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o seriescheck seriescheck.cpp
+// usage: seriescheck [series]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include "seriescodec.h"
+
+#define PAYLOAD_BUFFER_SIZE 51 // as in paxcounter_orig.conf
+
+static long errors = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      if (errors++ < 10)                                                       \
+        fprintf(stderr, "line %d: %s\n", __LINE__, #cond);                     \
+    }                                                                          \
+  } while (0)
+
+static void check_primitives(void) {
+  static const int32_t zz[] = {0, 1, -1, 2, -2, 65535, -65535, INT32_MAX,
+                               INT32_MIN};
+  static const uint32_t vi[] = {0, 1, 127, 128, 16383, 16384, 2097151,
+                                2097152, 268435455, 268435456, UINT32_MAX};
+  uint8_t buf[5];
+  uint32_t v;
+
+  for (int32_t x : zz)
+    CHECK(zigzag_decode(zigzag_encode(x)) == x);
+  CHECK(zigzag_encode(-1) == 1 && zigzag_encode(1) == 2);
+  for (uint32_t x : vi) {
+    uint8_t const n = varint_put(buf, x);
+    CHECK(n >= 1 && n <= 5);
+    CHECK(varint_get(buf, n, &v) == n && v == x);
+    CHECK(!n || varint_get(buf, n - 1, &v) == 0); // truncated
+  }
+}
+
+// next sample of a random walk, mostly small steps, sometimes large ones
+static void step(std::mt19937 &rng, uint16_t *counts, uint8_t k) {
+  for (uint8_t c = 0; c < k; c++)
+    switch (rng() % 8) {
+    case 0:
+      counts[c] = rng(); // jump
+      break;
+    case 1:
+      counts[c] += rng() % 2 ? 1 : -1; // may wrap at 0 / 65535
+      break;
+    default:
+      counts[c] += (int)(rng() % 21) - 10;
+    }
+}
+
+static void check_series(long runs, double &perseries, double &raw) {
+  std::mt19937 rng(1);
+  long total = 0, rawtotal = 0;
+
+  for (long r = 0; r < runs; r++) {
+    uint8_t const n = 2 * (1 + rng() % SERIES_MAX_COUNTS), k = n / 2;
+    bool const big = rng() % 2;
+    uint8_t series[PAYLOAD_BUFFER_SIZE], sample[2 * SERIES_MAX_COUNTS],
+        copy[PAYLOAD_BUFFER_SIZE];
+    uint16_t counts[SERIES_MAX_COUNTS];
+    std::vector<std::vector<uint16_t>> sent;
+    uint8_t size = 0, next;
+
+    for (uint8_t c = 0; c < k; c++)
+      counts[c] = rng() % 3 ? rng() % 200 : rng();
+    while (1) {
+      for (uint8_t c = 0; c < k; c++)
+        series_putcount(sample + 2 * c, counts[c], big);
+      memcpy(copy, series, size);
+      next = series_append(series, size, PAYLOAD_BUFFER_SIZE, sample, n, big);
+      if (!next) {
+        CHECK(size && !memcmp(copy, series, size)); // full, unchanged
+        break;
+      }
+      CHECK(next > size && next <= PAYLOAD_BUFFER_SIZE);
+      size = next;
+      sent.push_back(std::vector<uint16_t>(counts, counts + k));
+      step(rng, counts, k);
+    }
+
+    // other sample length is refused
+    if (n < 2 * SERIES_MAX_COUNTS)
+      CHECK(!series_append(series, size, 255, sample, n + 2, big));
+
+    // full series decodes to all samples
+    size_t got = 0;
+    int const samples = series_decode(
+        series, size, big, [&](const uint16_t *c, uint8_t kk) {
+          CHECK(kk == k && got < sent.size() &&
+                !memcmp(c, sent[got].data(), k * sizeof(uint16_t)));
+          got++;
+        });
+    CHECK(samples == (int)sent.size() && got == sent.size());
+    total += samples;
+    rawtotal += (PAYLOAD_BUFFER_SIZE - 1) / n;
+
+    // cut short series decode to first samples or are rejected, read from
+    // exact size heap copies, so reading past the end shows up with -fsanitize
+    for (uint8_t len = 0; len < size; len++) {
+      std::vector<uint8_t> cut(series, series + len);
+      size_t m = 0;
+      int const s = series_decode(
+          cut.data(), len, big, [&](const uint16_t *c, uint8_t kk) {
+            CHECK(kk == k && m < sent.size() &&
+                  !memcmp(c, sent[m].data(), k * sizeof(uint16_t)));
+            m++;
+          });
+      CHECK(s == -1 || (s >= 1 && s < samples && (size_t)s == m));
+    }
+  }
+  perseries = (double)total / runs;
+  raw = (double)rawtotal / runs;
+}
+
+int main(int argc, char **argv) {
+  long const runs = argc > 1 ? atol(argv[1]) : 20000;
+  double perseries, raw;
+
+  check_primitives();
+  printf("zig-zag and varint    %s\n", errors ? "FAILED" : "ok");
+  long const before = errors;
+  check_series(runs, perseries, raw);
+  printf("series round trip     %ld series, %.1f samples per series (raw "
+         "%.1f)  %s\n",
+         runs, perseries, raw, errors > before ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
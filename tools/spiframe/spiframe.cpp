@@ -0,0 +1,201 @@
+// spiframe.cpp
+// Host loopback of the SPI slave frame format, see include/spiframe.h.
+//
+// Runs random message backlogs through the same frame building as
+// spi_slave_task(), two frames queued at a time, lets a master poll them and
+// checks that all messages arrive in order and unchanged. Also checks the
+// crc against the CRC-16/GENIBUS check value, that single bit errors of a
+// frame never yield wrong records, and the command records of the master.
+// Prints the number of master polls needed, against one poll per message as
+// before.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o spiframe spiframe.cpp
+// usage: spiframe [rounds] [framesize]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "spiframe.h"
+
+#define PAYLOAD_BUFFER_SIZE 51 // as in paxcounter_orig.conf
+#define SPI_FRAMES 2
+#define RCMDPORT 2
+
+typedef struct {
+  uint8_t port;
+  std::vector<uint8_t> payload;
+} Message_t;
+
+typedef struct {
+  std::vector<uint8_t> tx;
+  uint16_t len;
+  uint8_t count;
+} Frame_t;
+
+static std::mt19937 rng(1);
+
+static Message_t random_message(void) {
+  Message_t m;
+  m.port = rng() % 17;
+  m.payload.resize(1 + rng() % PAYLOAD_BUFFER_SIZE);
+  for (uint8_t &b : m.payload)
+    b = (uint8_t)rng();
+  return m;
+}
+
+// as spi_frame_fill()
+static Frame_t fill(std::deque<Message_t> &queue, uint16_t framesize) {
+  Frame_t f{std::vector<uint8_t>(framesize, 0xee), 0, 0};
+  uint16_t used = 0, next;
+  while (!queue.empty()) {
+    const Message_t &m = queue.front();
+    next = spiframe_put(f.tx.data(), used, framesize, m.port, m.payload.data(),
+                        (uint8_t)m.payload.size());
+    if (!next)
+      break;
+    queue.pop_front();
+    used = next;
+    f.count++;
+  }
+  f.len = spiframe_end(f.tx.data(), used, framesize);
+  return f;
+}
+
+static bool check_crc(void) {
+  const char *s = "123456789";
+  uint16_t crc = crc16_genibus((const uint8_t *)s, 9);
+  printf("crc16 check value     %04x  %s\n", crc,
+         crc == 0xd64e ? "ok" : "FAILED");
+  return crc == 0xd64e;
+}
+
+static bool check_loopback(long rounds, uint16_t framesize) {
+  std::deque<Message_t> queue, sent;
+  std::deque<Frame_t> frames;
+  long messages = 0, polls = 0, errors = 0;
+
+  for (long r = 0; r < rounds; r++) {
+    // backlog of 1 .. 30 messages, as after a longer pause of the master
+    int n = 1 + rng() % 30;
+    for (int i = 0; i < n; i++) {
+      queue.push_back(random_message());
+      sent.push_back(queue.back());
+    }
+    messages += n;
+
+    // master polls until slave has nothing left
+    while (!queue.empty() || !frames.empty()) {
+      while (frames.size() < SPI_FRAMES && !queue.empty())
+        frames.push_back(fill(queue, framesize));
+
+      Frame_t f = frames.front();
+      frames.pop_front();
+      polls++;
+
+      if ((f.len % 4) || f.len < 8 || f.len > framesize) {
+        errors++;
+        continue;
+      }
+      int got = spiframe_parse(
+          f.tx.data(), f.len,
+          [&](uint8_t port, const uint8_t *payload, uint8_t size) {
+            if (sent.empty() || sent.front().port != port ||
+                sent.front().payload !=
+                    std::vector<uint8_t>(payload, payload + size))
+              errors++;
+            if (!sent.empty())
+              sent.pop_front();
+          });
+      if (got != f.count)
+        errors++;
+    }
+  }
+  if (!sent.empty())
+    errors++;
+
+  printf("loopback              %ld messages in %ld polls (%.1f per poll, "
+         "before 1.0), frame %u bytes  %s\n",
+         messages, polls, (double)messages / polls, framesize,
+         errors ? "FAILED" : "ok");
+  return !errors;
+}
+
+static bool check_biterrors(long rounds, uint16_t framesize) {
+  long detected = 0, harmless = 0, errors = 0;
+
+  for (long r = 0; r < rounds; r++) {
+    std::deque<Message_t> queue;
+    for (int i = 0; i < 10; i++)
+      queue.push_back(random_message());
+    std::deque<Message_t> sent(queue);
+    Frame_t f = fill(queue, framesize);
+
+    uint16_t bit = rng() % (f.len * 8);
+    f.tx[bit / 8] ^= 1 << (bit % 8);
+
+    bool wrong = false;
+    int got = spiframe_parse(
+        f.tx.data(), f.len,
+        [&](uint8_t port, const uint8_t *payload, uint8_t size) {
+          if (sent.front().port != port ||
+              sent.front().payload !=
+                  std::vector<uint8_t>(payload, payload + size))
+            wrong = true;
+          sent.pop_front();
+        });
+    if (wrong || (got >= 0 && got != f.count))
+      errors++;
+    else if (got < 0)
+      detected++;
+    else
+      harmless++; // bit of padding after end of frame
+  }
+
+  printf("single bit errors     %ld detected, %ld in padding, %ld wrong  %s\n",
+         detected, harmless, errors, errors ? "FAILED" : "ok");
+  return !errors;
+}
+
+static bool check_command(uint16_t framesize) {
+  std::vector<uint8_t> rx(framesize, 0);
+  const uint8_t cmd[] = {0x80}; // get config
+  int n = 0;
+  bool ok;
+
+  spiframe_put(rx.data(), 0, framesize, RCMDPORT, cmd, sizeof(cmd));
+  ok = spiframe_parse(rx.data(), framesize,
+                      [&](uint8_t port, const uint8_t *payload, uint8_t size) {
+                        n += port == RCMDPORT && size == 1 && *payload == 0x80;
+                      }) == 1 &&
+       n == 1;
+
+  // idle master, MOSI pulled up
+  std::fill(rx.begin(), rx.end(), 0xff);
+  ok = ok && spiframe_parse(rx.data(), framesize,
+                            [](uint8_t, const uint8_t *, uint8_t) {}) < 0;
+
+  printf("master command        %s\n", ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  long rounds = argc > 1 ? atol(argv[1]) : 10000;
+  uint16_t framesize = argc > 2 ? atoi(argv[2]) : 256;
+
+  if ((framesize % 4) || framesize > 4092 ||
+      framesize < SPI_RECORD_HEADER + PAYLOAD_BUFFER_SIZE) {
+    fprintf(stderr, "framesize must be a multiple of 4, %d .. 4092\n",
+            SPI_RECORD_HEADER + PAYLOAD_BUFFER_SIZE);
+    return 2;
+  }
+
+  bool ok = check_crc();
+  ok = check_loopback(rounds, framesize) && ok;
+  ok = check_biterrors(rounds, framesize) && ok;
+  ok = check_command(framesize) && ok;
+  return ok ? 0 : 1;
+}
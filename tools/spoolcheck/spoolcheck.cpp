@@ -0,0 +1,282 @@
+// spoolcheck.cpp
+// Host check of the payload spool log, see include/spoollog.h.
+//
+// Runs the spool log on a simulated NOR flash, which clears bits on write and
+// sets them on erase only, and cuts power at random points of a random
+// workload of appends, hand outs for two targets and erases ahead of time. A cut write leaves the
+// bits of the byte it stopped at half programmed, a cut erase leaves random
+// bytes of the sector erased. After each cut the log is mounted again from
+// flash and the workload goes on. Checks that
+//
+//   - every record handed out is unchanged,
+//   - each target gets its records in order of appending, a record is handed
+//     out again only if power was cut before it was marked as done,
+//   - every append that returned true is handed out to all of its targets,
+//   - a full ring drops its oldest records only, and counts them.
+//
+// Prints erase counts of the segments, which shall be even.
+//
+// build: g++ -O2 -std=c++11 -I../../include -o spoolcheck spoolcheck.cpp
+// usage: spoolcheck [cuts] [segments]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "spoollog.h"
+
+#define PAYLOAD_BUFFER_SIZE 51 // as in paxcounter_orig.conf
+#define SPOOL_SEGMENT_SIZE 4096
+#define SPOOL_MAX_SEGMENTS 64
+#define TARGET_A 0x01
+#define TARGET_B 0x04
+
+static std::mt19937 rng(1);
+
+struct PowerCut {};
+
+class SimFlash {
+
+public:
+  SimFlash(uint32_t segments)
+      : mem(segments * SPOOL_SEGMENT_SIZE, 0xff), erases(segments, 0),
+        budget(-1) {}
+
+  bool read(uint32_t addr, void *dst, uint32_t len) {
+    if (addr + len > mem.size())
+      return false;
+    memcpy(dst, mem.data() + addr, len);
+    return true;
+  }
+
+  bool write(uint32_t addr, const void *src, uint32_t len) {
+    const uint8_t *p = (const uint8_t *)src;
+    if (addr + len > mem.size())
+      return false;
+    for (uint32_t i = 0; i < len; i++) {
+      if (budget == 0) {
+        mem[addr + i] &= p[i] | (uint8_t)rng(); // half programmed
+        throw PowerCut();
+      }
+      if (budget > 0)
+        budget--;
+      mem[addr + i] &= p[i];
+    }
+    return true;
+  }
+
+  bool erase(uint32_t addr) {
+    if (addr % SPOOL_SEGMENT_SIZE || addr >= mem.size())
+      return false;
+    erases[addr / SPOOL_SEGMENT_SIZE]++;
+    if (budget >= 0 && budget < 64) {
+      for (uint32_t i = 0; i < SPOOL_SEGMENT_SIZE; i++)
+        if (rng() & 1)
+          mem[addr + i] = 0xff;
+      budget = 0;
+      throw PowerCut();
+    }
+    if (budget > 0)
+      budget -= 64;
+    memset(mem.data() + addr, 0xff, SPOOL_SEGMENT_SIZE);
+    return true;
+  }
+
+  uint32_t size(void) const { return mem.size(); }
+
+  std::vector<uint8_t> mem;
+  std::vector<uint32_t> erases;
+  long budget; // bytes to write until power is cut, -1 for never
+};
+
+typedef SpoolLog<SimFlash, SPOOL_SEGMENT_SIZE, SPOOL_MAX_SEGMENTS> Spool;
+
+// payload of record id, its first 4 bytes hold the id
+static std::vector<uint8_t> payload(uint32_t id) {
+  std::mt19937 r(id);
+  std::vector<uint8_t> p(4 + r() % (PAYLOAD_BUFFER_SIZE - 3));
+  memcpy(p.data(), &id, 4);
+  for (size_t i = 4; i < p.size(); i++)
+    p[i] = (uint8_t)r();
+  return p;
+}
+
+static uint8_t port(uint32_t id) { return 1 + id % 12; }
+
+struct Model {
+  std::map<uint32_t, uint8_t> acked;    // appends which returned true
+  std::map<uint32_t, uint8_t> torn;     // appends cut by power loss
+  std::map<uint8_t, uint32_t> last;     // last id handed out per target
+  std::map<uint8_t, bool> unconfirmed;  // last one handed out, done() was cut
+  std::map<uint8_t, long> handed, again;
+  uint32_t next = 1;
+  long errors = 0;
+};
+
+// hands out next record of target and checks it against model
+static bool handout(Spool &spool, Model &m, uint8_t target) {
+  uint8_t prt, len;
+  const uint8_t *data;
+  uint32_t id;
+
+  if (!spool.peek(target, prt, data, len))
+    return false;
+  memcpy(&id, data, 4);
+  std::vector<uint8_t> const want = payload(id);
+  auto a = m.acked.find(id);
+  uint8_t const targets = a != m.acked.end() ? a->second
+                          : m.torn.count(id) ? m.torn[id]
+                                             : 0;
+  if (!(targets & target) || len != want.size() || prt != port(id) ||
+      memcmp(data, want.data(), len)) {
+    m.errors++;
+  } else if (id == m.last[target] && m.unconfirmed[target]) {
+    m.again[target]++; // cut before done(), at least once is expected
+  } else if (id <= m.last[target]) {
+    m.errors++; // out of order or duplicate
+  } else {
+    // acked records of target in between must not be skipped
+    for (auto i = m.acked.upper_bound(m.last[target]);
+         i != m.acked.end() && i->first < id; i++)
+      if (i->second & target)
+        m.errors++;
+  }
+  m.last[target] = std::max(m.last[target], id);
+  m.unconfirmed[target] = true;
+  m.handed[target]++;
+  spool.done(target);
+  m.unconfirmed[target] = false;
+  return true;
+}
+
+// appends records and hands them out at random until power is cut
+static void workload(Spool &spool, Model &m, long steps, uint32_t limit) {
+  static const uint8_t targets[] = {TARGET_A, TARGET_B, TARGET_A | TARGET_B};
+
+  for (long s = 0; s < steps; s++) {
+    // keep backlog below half of ring, so nothing is dropped
+    uint32_t behind = 0;
+    for (auto a = m.acked.upper_bound(
+             std::min(m.last[TARGET_A], m.last[TARGET_B]));
+         a != m.acked.end(); a++)
+      if (((a->second & TARGET_A) && a->first > m.last[TARGET_A]) ||
+          ((a->second & TARGET_B) && a->first > m.last[TARGET_B])) {
+        behind = m.next - a->first;
+        break;
+      }
+    if (!(rng() % 16))
+      spool.prepare(); // as spool task does between hand outs
+    else if (rng() % 2 && behind < limit) {
+      uint32_t const id = m.next++;
+      uint8_t const t = targets[rng() % 3];
+      std::vector<uint8_t> const p = payload(id);
+      m.torn[id] = t;
+      if (spool.append(t, port(id), p.data(), p.size())) {
+        m.torn.erase(id);
+        m.acked[id] = t;
+      } else
+        m.errors++;
+    } else
+      handout(spool, m, rng() % 2 ? TARGET_A : TARGET_B);
+  }
+}
+
+static bool check_replay(long cuts, uint32_t segments) {
+  SimFlash flash(segments);
+  Model m;
+  uint32_t const limit = (segments - 2) * SPOOL_SEGMENT_SIZE /
+                         (2 * (SPOOL_RECORD_HEADER + PAYLOAD_BUFFER_SIZE));
+
+  for (long c = 0; c <= cuts; c++) {
+    Spool spool(flash);
+    if (!spool.mount())
+      m.errors++;
+    flash.budget = c < cuts ? (long)(rng() % 20000) : -1;
+    try {
+      workload(spool, m, c < cuts ? 1000000 : 2000, limit);
+      if (spool.overflows())
+        m.errors++;
+    } catch (PowerCut &) {
+      if (spool.overflows())
+        m.errors++;
+    }
+    flash.budget = -1;
+  }
+
+  // remount and drain what is left
+  Spool spool(flash);
+  spool.mount();
+  while (handout(spool, m, TARGET_A))
+    ;
+  while (handout(spool, m, TARGET_B))
+    ;
+  for (auto &a : m.acked)
+    for (uint8_t t : {TARGET_A, TARGET_B})
+      if ((a.second & t) && a.first > m.last[t])
+        m.errors++; // lost
+  if (spool.waiting(TARGET_A) || spool.waiting(TARGET_B) || spool.backlog())
+    m.errors++;
+
+  printf("replay after cuts     %ld cuts, %u appends, %ld + %ld handed out, "
+         "%ld + %ld again  %s\n",
+         cuts, (unsigned)m.acked.size(), m.handed[TARGET_A],
+         m.handed[TARGET_B], m.again[TARGET_A], m.again[TARGET_B],
+         m.errors ? "FAILED" : "ok");
+
+  auto mm = std::minmax_element(flash.erases.begin(), flash.erases.end());
+  printf("erases per segment    min %u max %u\n", *mm.first, *mm.second);
+  return !m.errors;
+}
+
+static bool check_overflow(uint32_t segments) {
+  SimFlash flash(segments);
+  Spool spool(flash);
+  uint32_t n = 0, id, expect;
+  long errors = 0;
+  uint8_t prt, len;
+  const uint8_t *data;
+
+  // fill ring three times over without handing out
+  spool.mount();
+  while (n < 3 * segments * SPOOL_SEGMENT_SIZE / 30) {
+    std::vector<uint8_t> const p = payload(++n);
+    if (!spool.append(TARGET_A, port(n), p.data(), p.size()))
+      errors++;
+  }
+  uint32_t const dropped = spool.overflows();
+
+  // after a remount, exactly the newest records must be left, in order
+  Spool again(flash);
+  again.mount();
+  for (expect = dropped + 1; again.peek(TARGET_A, prt, data, len); expect++) {
+    memcpy(&id, data, 4);
+    std::vector<uint8_t> const want = payload(id);
+    if (id != expect || len != want.size() || memcmp(data, want.data(), len))
+      errors++;
+    again.done(TARGET_A);
+  }
+  if (!dropped || expect != n + 1)
+    errors++;
+
+  printf("ring overflow         %u appends, %u dropped, newest %u kept  %s\n", n,
+         dropped, expect - dropped - 1, errors ? "FAILED" : "ok");
+  return !errors;
+}
+
+int main(int argc, char **argv) {
+  long cuts = argc > 1 ? atol(argv[1]) : 2000;
+  uint32_t segments = argc > 2 ? atoi(argv[2]) : 16;
+
+  if (segments < 4 || segments > SPOOL_MAX_SEGMENTS) {
+    fprintf(stderr, "segments must be 4 .. %d\n", SPOOL_MAX_SEGMENTS);
+    return 2;
+  }
+
+  bool ok = check_replay(cuts, segments);
+  ok = check_overflow(segments) && ok;
+  return ok ? 0 : 1;
+}